@@ -0,0 +1,113 @@
+#ifndef DYNARRAYSTACK_H
+#define DYNARRAYSTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**************
+ * STRUCTURES *
+ **************/
+
+// Number of elements reserved by `dynstackArrayNew` when no capacity is given (8 GiB of
+// address space on 64-bit systems, none of which is used until elements are pushed)
+#define DYNARRAY_DEFAULT_RESERVE ((size_t)1 << 30)
+
+// Number of bytes committed when the first element is pushed
+#define DYNARRAY_INITIAL_COMMIT (64 << 10)
+
+/*
+ * This stack implementation is an "Array Stack": elements are stored next to each other
+ * in one array, so pushing doesn't allocate a frame per element.
+ *
+ * Instead of growing the array with realloc (copying every element each time it doubles),
+ * the whole array is reserved as address space up front and physical memory is committed
+ * for it as it fills up, doubling each time. Elements therefore never move: a pointer to a
+ * slot stays valid for as long as the element is in the stack.
+ */
+typedef struct dynamicArrayStack {
+	void **slots;				// Bottom of the stack, at the start of the reservation
+	size_t size;				// Number of elements in the stack
+	size_t committed;			// Number of slots that are backed by memory
+	size_t reserved;			// Number of slots in the reservation
+	void (*deleteData)(void *);	// Function pointer to free an element in the stack
+	char *(*printData)(void *);	// Function pointer to create a string from a stack element
+} DynArrayStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Creates an empty array stack that can hold up to `maxCapacity` elements, or
+ * DYNARRAY_DEFAULT_RESERVE if `maxCapacity` is 0. `deleteFunc` and `printFunc` are the same
+ * as in `dynstackNew`, and either may be NULL: a stack without `deleteFunc` doesn't own its
+ * elements, so clearing or freeing it just forgets them. Returns NULL if the address space
+ * can't be reserved.
+ */
+DynArrayStack *dynstackArrayNew(void (*deleteFunc)(void *), char *(*printFunc)(void *), size_t maxCapacity);
+
+
+/*
+ * Removes every element from the stack without deleting the stack itself.
+ * The committed memory is kept for reuse.
+ */
+void dynstackArrayClear(DynArrayStack *stack);
+
+
+/*
+ * Frees all memory associated with the stack, including the stack itself.
+ */
+void dynstackArrayFree(DynArrayStack *stack);
+
+
+/*
+ * Pushes the data to the top of the stack, committing more memory if the committed slots
+ * are full. Returns false if `stack` is NULL, the reservation is full or memory can't be
+ * committed.
+ */
+bool dynstackArrayPush(DynArrayStack *stack, void *data);
+
+
+/*
+ * Returns the top of the stack without removing it.
+ */
+void *dynstackArrayPeek(const DynArrayStack *stack);
+
+
+/*
+ * Returns the top of the stack after removing it from the stack.
+ */
+void *dynstackArrayPop(DynArrayStack *stack);
+
+
+/*
+ * Returns the address of the slot holding the element `n` positions below the top (0 being
+ * the top itself), or NULL if there is no such element. The address doesn't change while
+ * the element is in the stack, no matter how much the stack grows.
+ */
+void **dynstackArraySlot(DynArrayStack *stack, size_t n);
+
+
+/*
+ * Returns the number of elements in the stack.
+ */
+size_t dynstackArrayGetSize(const DynArrayStack *stack);
+
+
+/*
+ * Returns true if the stack contains 0 elements, and false otherwise.
+ */
+bool dynstackArrayIsEmpty(const DynArrayStack *stack);
+
+
+/*
+ * Execute a function `func` on each element in the stack
+ * starting from the top and working downwards.
+ */
+void dynstackArrayMap(DynArrayStack *stack, void (*func)(void *));
+
+#endif	// DYNARRAYSTACK_H
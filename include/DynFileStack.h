@@ -0,0 +1,148 @@
+#ifndef DYNFILESTACK_H
+#define DYNFILESTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**************
+ * STRUCTURES *
+ **************/
+
+// Identifies a file used by a DynFileStack, and the version of its layout
+#define DYNFILESTACK_MAGIC "DYNF"
+#define DYNFILESTACK_VERSION 2
+
+// Size of a newly created stack file. The file doubles in size whenever it runs out of room.
+#define DYNFILESTACK_INITIAL_SIZE (1 << 20)
+
+/*
+ * When a DynFileStack flushes its mapping to the file with `msync`.
+ *
+ * Every policy survives a crash of the process itself, since the mapping is shared with the
+ * kernel's page cache. The policies only differ in what survives a crash of the whole machine:
+ *
+ *  DYNFILESTACK_SYNC_NONE   : nothing is flushed until `dynstackFileSync` or `dynstackFileClose`
+ *  DYNFILESTACK_SYNC_ASYNC  : every push/pop schedules a flush, but doesn't wait for it
+ *  DYNFILESTACK_SYNC_ALWAYS : every push/pop waits until it has reached the disk
+ */
+typedef enum dynamicFileStackSync {
+	DYNFILESTACK_SYNC_NONE,
+	DYNFILESTACK_SYNC_ASYNC,
+	DYNFILESTACK_SYNC_ALWAYS
+} DynFileSync;
+
+/*
+ * Header at the start of a stack file.
+ *
+ * Records are stored bottom to top after the header. Each one is its payload, padded to a
+ * multiple of 8 bytes, followed by a DynFileStackTrailer. Putting the trailer after the
+ * payload lets the top record (and the number of records) be found from `top` alone, so
+ * a push or pop takes effect with a single store to `top`.
+ */
+typedef struct dynamicFileStackHeader {
+	char magic[4];				// Always DYNFILESTACK_MAGIC (not null terminated)
+	uint32_t version;			// Always DYNFILESTACK_VERSION
+	uint64_t top;				// Offset one past the end of the top record
+} DynFileStackHeader;
+
+/*
+ * End of every record in a stack file.
+ */
+typedef struct dynamicFileStackTrailer {
+	uint64_t length;			// Unpadded length of the record's payload
+	uint64_t count;				// Number of records in the stack, up to this one included
+} DynFileStackTrailer;
+
+/*
+ * A stack of byte records that lives in a memory-mapped file, so that its contents
+ * outlive the process without ever being explicitly saved.
+ *
+ * Unlike a DynStack the elements are copied into the file, so they must not contain pointers.
+ */
+typedef struct dynamicFileStack {
+	int fd;						// File descriptor of the stack file
+	char *map;					// Start of the shared mapping of the whole file
+	size_t mapSize;				// Size of the mapping (and the file) in bytes
+	DynFileSync sync;			// When changes are flushed to disk
+	bool failed;				// Whether flushing has failed since the last `dynstackFileSync`
+} DynFileStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Opens the stack stored in the file `filename`, creating an empty one if the file
+ * doesn't exist. Reopening an existing stack is O(1); records are only paged in from
+ * the file when they are used.
+ *
+ * Returns NULL if the file can't be opened or mapped, or isn't a stack file (including
+ * when its top record is corrupt).
+ */
+DynFileStack *dynstackFileOpen(const char *filename, DynFileSync sync);
+
+
+/*
+ * Flushes the stack to disk, unmaps it and frees the DynFileStack struct.
+ * The file itself is left in place so the stack can be reopened later.
+ */
+void dynstackFileClose(DynFileStack *stack);
+
+
+/*
+ * Waits until every change made to the stack has been written to disk.
+ * Returns false if the flush fails, or if flushing a push or pop has failed since the
+ * last call.
+ */
+bool dynstackFileSync(DynFileStack *stack);
+
+
+/*
+ * Copies `length` bytes starting at `record` to the top of the stack, growing the
+ * file if necessary. Returns false if `stack` is NULL, the file can't be grown, or the
+ * stack's sync policy flushes the push and that fails. The record is only published once
+ * it has been flushed, so a failed push leaves the stack as it was.
+ *
+ * Growing the file remaps it, which invalidates every pointer previously returned
+ * by `dynstackFilePeek` and `dynstackFilePop`.
+ */
+bool dynstackFilePush(DynFileStack *stack, const void *record, size_t length);
+
+
+/*
+ * Returns a pointer to the record at the top of the stack without removing it,
+ * and stores its length in `length` (if `length` isn't NULL). Returns NULL if the stack
+ * is empty, or if the record's trailer is corrupt and would put it outside the file.
+ *
+ * The record lives inside the mapping; it stays valid until the next push.
+ */
+const void *dynstackFilePeek(const DynFileStack *stack, size_t *length);
+
+
+/*
+ * Removes the record at the top of the stack and returns a pointer to it, storing its
+ * length in `length` (if `length` isn't NULL). Only the header's top offset is changed.
+ * Returns NULL if the stack is empty, or if the stack's sync policy flushes the pop and
+ * that fails, in which case the record is left on the stack.
+ *
+ * The record lives inside the mapping; it stays valid until the next push.
+ */
+const void *dynstackFilePop(DynFileStack *stack, size_t *length);
+
+
+/*
+ * Returns the number of records in the stack.
+ */
+uint64_t dynstackFileGetSize(const DynFileStack *stack);
+
+
+/*
+ * Returns true if the stack contains 0 records, and false otherwise.
+ */
+bool dynstackFileIsEmpty(const DynFileStack *stack);
+
+#endif	// DYNFILESTACK_H
@@ -0,0 +1,80 @@
+#ifndef DYNHANDOFF_H
+#define DYNHANDOFF_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+/*
+ * Hands elements from exactly one producer thread to exactly one consumer thread.
+ *
+ * The producer pushes into a private batch of frames, which needs no synchronization at
+ * all, and then publishes the whole batch at once. The consumer takes everything that has
+ * been published at once and splices it onto one of its own DynStacks. Neither side ever
+ * loops on a compare-and-swap: publishing is one atomic exchange and one store, and taking
+ * is one atomic exchange, no matter how many elements are transferred.
+ *
+ * Elements come out in stack order: the consumer's stack ends up with the most recently
+ * pushed element on top.
+ *
+ * `shared` is written by both threads, while the rest is only used by the producer, so they
+ * are kept on separate cache lines: taking doesn't evict the producer's batch from its cache.
+ * `kept` is only used by the consumer, and shares the line it touches anyway.
+ */
+typedef struct dynamicStackHandoff {
+	DynFrame *shared;			// Published frames waiting for the consumer
+	DynFrame *kept;				// Frames taken earlier that the consumer's stack couldn't hold
+	char sharedPadding[DYNSTACK_CACHE_LINE - 2 * sizeof(DynFrame *)];
+	DynFrame *batch;			// Producer's frames that haven't been published yet
+	DynFrame *batchBottom;		// Last frame of `batch`
+	size_t batchSize;			// Number of frames in `batch`
+} DynHandoff;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Allocates an empty handoff, aligned to a cache line.
+ * Returns NULL if memory can't be allocated.
+ */
+DynHandoff *dynstackHandoffNew(void);
+
+
+/*
+ * Frees the handoff along with any frames that were pushed but never taken, calling
+ * `deleteFunc` on their data (unless it is NULL). Neither thread may be using the handoff.
+ */
+void dynstackHandoffFree(DynHandoff *handoff, void (*deleteFunc)(void *));
+
+
+/*
+ * Adds the data to the producer's private batch. Only the producer thread may call this.
+ * Returns false if `handoff` is NULL or memory can't be allocated.
+ */
+bool dynstackHandoffPush(DynHandoff *handoff, void *data);
+
+
+/*
+ * Makes the producer's batch visible to the consumer, on top of anything published
+ * earlier that the consumer hasn't taken yet. Only the producer thread may call this.
+ */
+void dynstackHandoffPublish(DynHandoff *handoff);
+
+
+/*
+ * Takes every published element and pushes them onto `into` in one step, keeping their
+ * order. Only the consumer thread may call this. Returns the number of elements taken, or 0
+ * if `into` can't hold them all; the elements are then kept aside and taken first next time.
+ */
+size_t dynstackHandoffTake(DynHandoff *handoff, DynStack *into);
+
+#endif	// DYNHANDOFF_H
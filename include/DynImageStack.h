@@ -0,0 +1,99 @@
+#ifndef DYNIMAGESTACK_H
+#define DYNIMAGESTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+/*
+ * A record pushed onto a DynImageStack after it was opened. These are kept in memory,
+ * since the image itself is never written to.
+ */
+typedef struct dynamicImageRecord {
+	size_t length;				// Number of bytes in `bytes`
+	char bytes[];				// Copy of the pushed record
+} DynImageRecord;
+
+/*
+ * A read-only view of a file written by `dynstackSave`, used as a stack of serialized
+ * records without copying or deserializing them.
+ *
+ * Opening the image only maps it, so it takes the same time no matter how large the
+ * saved stack is; pages of the file are only read once a pop reaches them. Popping a
+ * record from the image just moves `cursor` past it. Records pushed afterwards are
+ * copied into `overlay` (copy-on-write) and popped from there first.
+ */
+typedef struct dynamicImageStack {
+	const char *map;			// Start of the read-only mapping of the whole file
+	size_t mapSize;				// Size of the mapping in bytes
+	size_t cursor;				// Offset of the next record of the image to be popped
+	uint64_t remaining;			// Number of records of the image that haven't been popped
+	DynStack *overlay;			// Records pushed since the image was opened (DynImageRecord *)
+	DynImageRecord *popped;		// Last record popped from `overlay`, freed by the next operation
+} DynImageStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Maps the file `filename`, written by `dynstackSave`, as a stack. This is O(1) in the
+ * number of saved elements. Returns NULL if the file can't be mapped or isn't a
+ * DynStack file.
+ */
+DynImageStack *dynstackImageOpen(const char *filename);
+
+
+/*
+ * Unmaps the image and frees every record pushed onto it, as well as the stack itself.
+ */
+void dynstackImageClose(DynImageStack *stack);
+
+
+/*
+ * Copies `length` bytes starting at `record` to the top of the stack.
+ * Returns false if `stack` is NULL or memory can't be allocated.
+ */
+bool dynstackImagePush(DynImageStack *stack, const void *record, size_t length);
+
+
+/*
+ * Returns a pointer to the serialized record at the top of the stack without removing it,
+ * and stores its length in `length` (if `length` isn't NULL).
+ *
+ * The pointer stays valid until the next push or pop.
+ */
+const void *dynstackImagePeek(const DynImageStack *stack, size_t *length);
+
+
+/*
+ * Removes the serialized record at the top of the stack and returns a pointer to it,
+ * storing its length in `length` (if `length` isn't NULL). Records of the image are
+ * returned in place, so this is where their pages get faulted in.
+ *
+ * The pointer stays valid until the next push or pop.
+ */
+const void *dynstackImagePop(DynImageStack *stack, size_t *length);
+
+
+/*
+ * Returns the number of records in the stack.
+ */
+uint64_t dynstackImageGetSize(const DynImageStack *stack);
+
+
+/*
+ * Returns true if the stack contains 0 records, and false otherwise.
+ */
+bool dynstackImageIsEmpty(const DynImageStack *stack);
+
+#endif	// DYNIMAGESTACK_H
@@ -0,0 +1,138 @@
+#ifndef DYNJOURNAL_H
+#define DYNJOURNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+// Identifies a journal file, and the version of its layout
+#define DYNJOURNAL_MAGIC "DYNJ"
+#define DYNJOURNAL_VERSION 1
+
+// Values for `syncEvery` in `dynstackJournalOpen` with a special meaning
+#define DYNJOURNAL_SYNC_NEVER 0		// Write every operation, but leave flushing it to the OS
+#define DYNJOURNAL_SYNC_EACH 1		// fdatasync after every operation
+
+// Size of the buffer holding operations that haven't been committed yet
+#define DYNJOURNAL_BUFFER_SIZE (1 << 16)
+
+// The journal is compacted into a snapshot once it grows beyond this many bytes
+#define DYNJOURNAL_COMPACT_SIZE (64 << 20)
+
+/*
+ * Header at the start of a journal file. The journal is a list of operations that
+ * have to be replayed on top of the snapshot `<path>.<generation>` (written by
+ * `dynstackSave`) to recover the stack; generation 0 means there is no snapshot.
+ *
+ * Each operation is a single byte, '+' for a push or '-' for a pop. A push is followed
+ * by a `uint64_t` payload length and the serialized element.
+ */
+typedef struct dynamicStackJournalHeader {
+	char magic[4];				// Always DYNJOURNAL_MAGIC (not null terminated)
+	uint32_t version;			// Always DYNJOURNAL_VERSION
+	uint64_t generation;		// Snapshot that this journal is replayed on top of
+} DynJournalHeader;
+
+/*
+ * A DynStack whose pushes and pops are recorded in an append-only journal, so that
+ * the stack can be recovered after a crash.
+ *
+ * Operations are committed in groups of `syncEvery`: the group is written with a single
+ * write and made durable with a single fdatasync. An operation is only guaranteed to
+ * survive a crash once its group has been committed.
+ */
+typedef struct dynamicStackJournal {
+	DynStack *stack;			// The stack being journaled
+	int fd;						// File descriptor of the journal
+	char *path;					// Path of the journal; snapshots are named after it
+	uint64_t generation;		// Generation of the current snapshot
+	uint64_t journalSize;		// Number of bytes in the journal file
+	unsigned int syncEvery;		// Number of operations per group commit
+	unsigned int pending;		// Number of operations waiting to be committed
+	bool failed;				// Whether committing has failed since the last `dynstackJournalSync`
+	char *buffer;				// Operations waiting to be committed
+	size_t used;				// Number of bytes used in `buffer`
+	void *(*serializeData)(void *, size_t *);	// Function pointer to serialize an element
+} DynJournal;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Opens the journal at `path` and recovers its stack by loading its latest snapshot
+ * and replaying every complete operation recorded after it. A journal that doesn't
+ * exist yet is created with an empty stack.
+ *
+ * `deleteFunc` and `printFunc` are the same as in `dynstackNew`, and `serializeFunc`
+ * and `deserializeFunc` are the same as in `dynstackSave` and `dynstackLoad`.
+ * `syncEvery` is the number of operations committed together (see DYNJOURNAL_SYNC_NEVER
+ * and DYNJOURNAL_SYNC_EACH).
+ *
+ * Returns NULL if the journal or its snapshot can't be read, or if memory can't be allocated.
+ */
+DynJournal *dynstackJournalOpen(const char *path, void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*serializeFunc)(void *, size_t *), void *(*deserializeFunc)(const void *, size_t),
+		unsigned int syncEvery);
+
+
+/*
+ * Commits any pending operations, closes the journal and frees the journaled stack.
+ */
+void dynstackJournalClose(DynJournal *journal);
+
+
+/*
+ * Returns the journaled stack. It may be read freely, but it must only be modified
+ * through `dynstackJournalPush` and `dynstackJournalPop` or the changes won't be recovered.
+ */
+DynStack *dynstackJournalGetStack(const DynJournal *journal);
+
+
+/*
+ * Records a push of `data` in the journal and then pushes it onto the stack.
+ * Returns false, leaving both the journal and the stack as they were (so `data` still
+ * belongs to the caller), if the push can't be recorded or completed.
+ *
+ * Once the element is on the stack, true is returned even if committing its group (or the
+ * compaction it triggered) fails; the failure is reported by the next `dynstackJournalSync`.
+ */
+bool dynstackJournalPush(DynJournal *journal, void *data);
+
+
+/*
+ * Records a pop in the journal, then pops and returns the top of the stack.
+ * Returns NULL if the stack is empty or the pop can't be recorded. As with
+ * `dynstackJournalPush`, a failure to commit the pop is reported by `dynstackJournalSync`.
+ */
+void *dynstackJournalPop(DynJournal *journal);
+
+
+/*
+ * Writes and fdatasyncs every pending operation, regardless of `syncEvery`.
+ * Returns false if the journal can't be written, or if committing an operation has failed
+ * since the last call.
+ */
+bool dynstackJournalSync(DynJournal *journal);
+
+
+/*
+ * Saves the whole stack as a new snapshot and starts a new, empty journal on top of it.
+ * This happens automatically once the journal grows beyond DYNJOURNAL_COMPACT_SIZE.
+ *
+ * The new journal atomically replaces the old one only after the snapshot is on disk, and
+ * the old snapshot is only removed once the replacement is durable, so a crash at any point
+ * recovers either the old or the new state.
+ */
+bool dynstackJournalCompact(DynJournal *journal);
+
+#endif	// DYNJOURNAL_H
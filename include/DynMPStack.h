@@ -0,0 +1,85 @@
+#ifndef DYNMPSTACK_H
+#define DYNMPSTACK_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+/*
+ * A stack that any number of threads may push onto at the same time, emptied all at once
+ * by a single consumer thread.
+ *
+ * Pushing is a single compare-and-swap on `top` (retried only if another push got there
+ * first), and taking is a single atomic exchange of `top` with NULL. Since frames are never
+ * popped one at a time, a frame that is reused after being taken can't be mistaken for the
+ * old one (the ABA problem), and no frame can be freed while a push is still looking at it.
+ *
+ * `top` is contended by every producer, so the stack is padded to a whole cache line (and
+ * allocated on a cache line boundary) to keep unrelated data from sharing that line.
+ * `kept` is only used by the consumer, and shares the line it touches anyway.
+ */
+typedef struct dynamicMPStack {
+	DynFrame *top;				// Most recently pushed frame
+	DynFrame *kept;				// Frames taken earlier that the consumer's stack couldn't hold
+	char padding[DYNSTACK_CACHE_LINE - 2 * sizeof(DynFrame *)];
+} DynMPStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Allocates an empty stack, aligned to a cache line.
+ * Returns NULL if memory can't be allocated.
+ */
+DynMPStack *dynstackMPNew(void);
+
+
+/*
+ * Frees the stack along with any frames that were never taken, calling `deleteFunc` on
+ * their data (unless it is NULL). No other thread may be using the stack.
+ */
+void dynstackMPFree(DynMPStack *stack, void (*deleteFunc)(void *));
+
+
+/*
+ * Pushes the data to the top of the stack. May be called from any number of threads.
+ * Returns false if `stack` is NULL or memory can't be allocated.
+ */
+bool dynstackMPPush(DynMPStack *stack, void *data);
+
+
+/*
+ * Detaches every frame from the stack and returns the first of them, leaving the stack
+ * empty. The frames are linked through `next` from the most recently pushed to the oldest,
+ * unless `fifo` is set, in which case the chain is reversed to run from oldest to newest.
+ *
+ * The caller owns the returned frames, and must free each of them with `free` after use.
+ */
+DynFrame *dynstackMPTakeAll(DynMPStack *stack, bool fifo);
+
+
+/*
+ * Detaches every frame from the stack and pushes them onto `into` in one step, so that the
+ * most recently pushed element ends up on top. Returns the number of elements moved, or 0 if
+ * `into` can't hold them all; the elements are then kept aside and taken first next time.
+ */
+size_t dynstackMPTakeAllInto(DynMPStack *stack, DynStack *into);
+
+
+/*
+ * Returns true if the stack contains 0 elements, and false otherwise. Only the consumer
+ * thread may call this, since it also looks at the elements kept aside for the consumer.
+ * Other threads may push at any moment, so the answer can be out of date immediately.
+ */
+bool dynstackMPIsEmpty(const DynMPStack *stack);
+
+#endif	// DYNMPSTACK_H
@@ -0,0 +1,177 @@
+#ifndef DYNOPERANDSTACK_H
+#define DYNOPERANDSTACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**************
+ * STRUCTURES *
+ **************/
+
+// Maximum number of lazily committed operand stacks that can exist at the same time
+#define DYNOPERAND_MAX_LAZY 64
+
+// Number of bytes committed at a time when a lazily committed operand stack grows
+#define DYNOPERAND_COMMIT_SIZE (64 << 10)
+
+/*
+ * Type of the value held by a DynValue.
+ */
+typedef enum dynamicValueTag {
+	DYNVALUE_NIL,
+	DYNVALUE_INT,
+	DYNVALUE_FLOAT,
+	DYNVALUE_PTR
+} DynTag;
+
+/*
+ * A tagged value, stored directly in an operand stack slot.
+ */
+typedef struct dynamicValue {
+	DynTag tag;
+	union {
+		int64_t i;
+		double f;
+		void *p;
+	} as;
+} DynValue;
+
+/*
+ * The operand stack of a bytecode interpreter.
+ *
+ * Unlike a DynStack, values are stored by value in one contiguous, preallocated region,
+ * and the push/pop/stack-shuffling functions below are inlined and don't check anything:
+ * no NULL checks, no bounds checks, no size bookkeeping beyond moving `sp`. Instead the
+ * region sits between two inaccessible guard pages, so pushing past the capacity (or
+ * popping past the bottom) faults immediately rather than corrupting memory.
+ *
+ * A stack created by `dynstackOperandReserve` only commits memory as it is used: the slots
+ * above `committed` are reserved but inaccessible, and the fault handler installed by
+ * `dynstackOperandInstallFaultHandler` commits more of them whenever a push touches one.
+ */
+typedef struct dynamicOperandStack {
+	DynValue *sp;				// Slot just above the top of the stack
+	DynValue *base;				// Slot at the bottom of the stack
+	size_t capacity;			// Number of slots between the guard pages
+	char *committed;			// End of the slots that are readable and writable
+	void *mapping;				// Start of the reservation, including both guard pages
+	size_t mappingSize;			// Size of the reservation in bytes
+} DynOperandStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Creates an empty operand stack with room for at least `capacity` values (rounded up to
+ * fill whole pages). Returns NULL if `capacity` is 0 or memory can't be mapped.
+ */
+DynOperandStack *dynstackOperandNew(size_t capacity);
+
+
+/*
+ * Creates an empty operand stack that reserves room for `capacity` values (rounded up to
+ * fill whole pages) but only commits the first DYNOPERAND_COMMIT_SIZE bytes of it. The rest
+ * is committed by the fault handler as pushes reach it, so a huge capacity costs nothing
+ * until it is used, and pushes still don't check anything.
+ *
+ * `dynstackOperandInstallFaultHandler` must have been called first. Returns NULL if it
+ * hasn't, if DYNOPERAND_MAX_LAZY such stacks already exist, or if memory can't be reserved.
+ */
+DynOperandStack *dynstackOperandReserve(size_t capacity);
+
+
+/*
+ * Installs a SIGSEGV handler that commits memory for stacks created by
+ * `dynstackOperandReserve` when they grow, and reports overflows of any operand stack.
+ *
+ * A push past the capacity of a stack (or a pop past its bottom) calls
+ * `overflowFunc(stack)`; the hook can recover by jumping out of the signal handler (with
+ * `siglongjmp`), otherwise the process is aborted once it returns. `overflowFunc` may be
+ * NULL to always abort. Faults that don't belong to an operand stack are passed on to the
+ * handler that was installed before. Returns false if the handler can't be installed.
+ */
+bool dynstackOperandInstallFaultHandler(void (*overflowFunc)(DynOperandStack *));
+
+
+/*
+ * Unmaps the operand stack's memory and frees the stack itself.
+ */
+void dynstackOperandFree(DynOperandStack *stack);
+
+
+/*
+ * Returns the number of values in the operand stack.
+ */
+static inline size_t dynstackOperandDepth(const DynOperandStack *stack) {
+	return (size_t)(stack->sp - stack->base);
+}
+
+
+/*
+ * Pushes a value onto the operand stack.
+ */
+static inline void dynstackOperandPush(DynOperandStack *stack, DynValue value) {
+	*(stack->sp)++ = value;
+}
+
+
+/*
+ * Removes and returns the value at the top of the operand stack.
+ */
+static inline DynValue dynstackOperandPop(DynOperandStack *stack) {
+	return *--(stack->sp);
+}
+
+
+/*
+ * Returns the value `n` slots below the top of the operand stack (0 being the top itself).
+ */
+static inline DynValue dynstackOperandPeek(const DynOperandStack *stack, size_t n) {
+	return stack->sp[-1 - (ptrdiff_t)n];
+}
+
+
+/*
+ * Discards the top `n` values of the operand stack at once.
+ */
+static inline void dynstackOperandPopN(DynOperandStack *stack, size_t n) {
+	stack->sp -= n;
+}
+
+
+/*
+ * Pushes a copy of the value at the top of the operand stack: ( a -- a a ).
+ */
+static inline void dynstackOperandDup(DynOperandStack *stack) {
+	stack->sp[0] = stack->sp[-1];
+	(stack->sp)++;
+}
+
+
+/*
+ * Exchanges the top two values of the operand stack: ( a b -- b a ).
+ */
+static inline void dynstackOperandSwap(DynOperandStack *stack) {
+	DynValue top = stack->sp[-1];
+	stack->sp[-1] = stack->sp[-2];
+	stack->sp[-2] = top;
+}
+
+
+/*
+ * Rotates the third value of the operand stack up to the top: ( a b c -- b c a ).
+ */
+static inline void dynstackOperandRot(DynOperandStack *stack) {
+	DynValue third = stack->sp[-3];
+	stack->sp[-3] = stack->sp[-2];
+	stack->sp[-2] = stack->sp[-1];
+	stack->sp[-1] = third;
+}
+
+#endif	// DYNOPERANDSTACK_H
@@ -0,0 +1,86 @@
+#ifndef DYNPRIORITYSTACK_H
+#define DYNPRIORITYSTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+// Maximum number of priority levels, one per bit of `nonEmpty`
+#define DYNPRIORITY_MAX_LEVELS 64
+
+/*
+ * A collection of DynStacks, one per priority level, that always pops from the highest
+ * priority level that isn't empty. Level 0 has the lowest priority.
+ *
+ * Bit `n` of `nonEmpty` is set whenever level `n` holds an element, so the highest
+ * non-empty level is found by counting the leading zeros of `nonEmpty` instead of
+ * checking every level. Every level shares a single frame pool.
+ */
+typedef struct dynamicPriorityStack {
+	DynStack *levels[DYNPRIORITY_MAX_LEVELS];	// Stack for each priority level
+	unsigned int levelCount;	// Number of levels in use
+	uint64_t nonEmpty;			// Bitmap of the levels that hold elements
+	size_t size;				// Number of elements across every level
+	DynFramePool *pool;			// Frames shared by every level
+} DynPriorityStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Creates an empty stack with `levelCount` priority levels. `deleteFunc` and `printFunc` are
+ * the same as in `dynstackNew`. Returns NULL if `levelCount` is 0 or greater than
+ * DYNPRIORITY_MAX_LEVELS, or if memory can't be allocated.
+ */
+DynPriorityStack *dynstackPriorityNew(unsigned int levelCount, void (*deleteFunc)(void *), char *(*printFunc)(void *));
+
+
+/*
+ * Frees all memory associated with the stack, including every element and the stack itself.
+ */
+void dynstackPriorityFree(DynPriorityStack *stack);
+
+
+/*
+ * Pushes the data to the top of priority level `level`.
+ * Returns false if `stack` is NULL, `level` doesn't exist or memory can't be allocated.
+ */
+bool dynstackPriorityPush(DynPriorityStack *stack, unsigned int level, void *data);
+
+
+/*
+ * Returns the top of the highest non-empty priority level without removing it, and stores
+ * that level in `level` (if `level` isn't NULL). Returns NULL if every level is empty.
+ */
+void *dynstackPriorityPeek(const DynPriorityStack *stack, unsigned int *level);
+
+
+/*
+ * Removes and returns the top of the highest non-empty priority level in O(1), and stores
+ * that level in `level` (if `level` isn't NULL). Returns NULL if every level is empty.
+ */
+void *dynstackPriorityPop(DynPriorityStack *stack, unsigned int *level);
+
+
+/*
+ * Returns the number of elements across every priority level.
+ */
+size_t dynstackPriorityGetSize(const DynPriorityStack *stack);
+
+
+/*
+ * Returns true if every priority level is empty, and false otherwise.
+ */
+bool dynstackPriorityIsEmpty(const DynPriorityStack *stack);
+
+#endif	// DYNPRIORITYSTACK_H
@@ -0,0 +1,120 @@
+#ifndef DYNSPILLSTACK_H
+#define DYNSPILLSTACK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+/*
+ * Location of a group of elements that were spilled to the temporary file.
+ * Chunks form a stack of their own, the most recently spilled chunk first, which
+ * is always the one at the end of the file.
+ */
+typedef struct dynamicSpillChunk {
+	long long offset;			// Offset of the chunk's first record in the file
+	uint64_t bytes;				// Size of the chunk in the file
+	size_t count;				// Number of elements in the chunk
+	bool prefetched;			// Whether the OS has been asked to read the chunk ahead
+	struct dynamicSpillChunk *next;
+} DynSpillChunk;
+
+/*
+ * A stack that can grow beyond the available memory.
+ *
+ * At most `memoryBudget` elements are kept in an ordinary DynStack. When a push goes
+ * past the budget, the bottom `chunkSize` elements in memory are serialized to a
+ * temporary file and deleted. When pops empty the stack in memory, the most recently
+ * spilled chunk is read back in.
+ *
+ * Chunks are written and read in the same format as `dynstackSave`, one record
+ * (a `uint64_t` length followed by the serialized element) per element, top to bottom.
+ *
+ * The elements in memory are split into groups of `chunkSize`, counting from the bottom,
+ * and the frame right above each full group is remembered as pushes and pops go past it.
+ * Spilling starts right below the lowest of those frames, so it only walks the chunk it
+ * writes out instead of the whole stack in memory.
+ */
+typedef struct dynamicSpillStack {
+	DynStack *hot;				// Top of the stack, held in memory
+	FILE *file;					// Temporary file holding the spilled chunks
+	DynSpillChunk *chunks;		// Spilled chunks, most recent first
+	unsigned long long spilled;	// Number of elements in the file
+	size_t memoryBudget;		// Maximum number of elements held in memory
+	size_t chunkSize;			// Number of elements spilled or read back at once
+	DynFrame **boundaries;		// Ring of the frames right above each group in memory, lowest first
+	size_t boundaryFirst;		// Index of the lowest boundary in `boundaries`
+	size_t boundaryCount;		// Number of boundaries in `boundaries`
+	size_t boundaryCapacity;	// Number of slots in `boundaries`
+	void *(*serializeData)(void *, size_t *);			// Function pointer to serialize an element
+	void *(*deserializeData)(const void *, size_t);	// Function pointer to recreate an element
+} DynSpillStack;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Creates an empty spillable stack. `deleteFunc` and `printFunc` are the same as in
+ * `dynstackNew`, and `serializeFunc` and `deserializeFunc` are the same as in
+ * `dynstackSave` and `dynstackLoad`.
+ *
+ * `chunkSize` must be greater than 0 and less than `memoryBudget`; NULL is returned
+ * otherwise, or if the temporary file can't be created.
+ */
+DynSpillStack *dynstackSpillNew(void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*serializeFunc)(void *, size_t *), void *(*deserializeFunc)(const void *, size_t),
+		size_t memoryBudget, size_t chunkSize);
+
+
+/*
+ * Frees every element (in memory or spilled), the temporary file and the stack itself.
+ */
+void dynstackSpillFree(DynSpillStack *stack);
+
+
+/*
+ * Pushes the data to the top of the stack, spilling the bottom of the in-memory
+ * segment to the file if it goes over budget. Returns false if the push or the
+ * spill can't be completed.
+ */
+bool dynstackSpillPush(DynSpillStack *stack, void *data);
+
+
+/*
+ * Returns the top of the stack without removing it, reading the most recently
+ * spilled chunk back in if nothing is left in memory.
+ */
+void *dynstackSpillPeek(DynSpillStack *stack);
+
+
+/*
+ * Returns the top of the stack after removing it from the stack, reading the most
+ * recently spilled chunk back in if nothing is left in memory.
+ *
+ * Once the in-memory segment runs low, the OS is asked to start reading the next
+ * chunk in the background so that it is already cached when it is needed.
+ */
+void *dynstackSpillPop(DynSpillStack *stack);
+
+
+/*
+ * Returns the number of elements in the stack, in memory and spilled.
+ */
+unsigned long long dynstackSpillGetSize(const DynSpillStack *stack);
+
+
+/*
+ * Returns true if the stack contains 0 elements, and false otherwise.
+ */
+bool dynstackSpillIsEmpty(const DynSpillStack *stack);
+
+#endif	// DYNSPILLSTACK_H
@@ -2,6 +2,7 @@
 #define DYNSTACK_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,50 @@
  * STRUCTURES *
  **************/
 
+// Version of the layout of the structures below. It changes whenever a structure changes
+// in a way that breaks code compiled against an older version of this header; compare it
+// with `dynstackAbiVersion()` to make sure the library matches the header.
+//  1 : original layout, with `unsigned int` element counts
+//  2 : element counts are `size_t`
+//  3 : DynStack fields used by every push/pop come first
+//  4 : DynStack holds inline frames for its first elements
+//  5 : DynStack fields written by pushes and pops are padded onto a cache line of their own
+//  6 : Whether a DynStack owns its pool is kept in `ownsPool` instead of its flags
+#define DYNSTACK_ABI_VERSION 6
+
+// Size of a cache line, the unit in which CPU cores exchange memory
+#define DYNSTACK_CACHE_LINE 64
+
+// Number of frames built into every DynStack, so that small stacks never allocate frames
+#define DYNSTACK_INLINE_FRAMES 8
+
+// Flags for `dynstackNewFlags`
+#define DYNSTACK_THREADSAFE 0x1		// Every function locks the stack while using it
+#define DYNSTACK_ALIGNED 0x2		// The DynStack struct gets cache lines of its own
+#define DYNSTACK_BORROWED 0x4		// The stack doesn't own its elements, so never deletes them
+#define DYNSTACK_TRIVIAL 0x8		// The elements need no cleanup (e.g. integers cast to pointers)
+#define DYNSTACK_REALTIME 0x20		// Set by `dynstackNewRealtime`: pushes only use its locked pool
+
+// Identifies a file written by `dynstackSave`, and the version of its layout
+#define DYNSTACK_FILE_MAGIC "DYNS"
+#define DYNSTACK_FILE_VERSION 1
+
+// Size of the buffer used to batch small records into large writes while saving
+#define DYNSTACK_IO_BUFFER_SIZE (1 << 20)
+
+/*
+ * Header at the start of a file written by `dynstackSave`. It is followed by `count`
+ * records ordered from the top of the stack to the bottom, each of which is a
+ * `uint64_t` payload length followed by that many bytes of serialized element data.
+ * All integers are stored in host byte order.
+ */
+typedef struct dynamicStackFileHeader {
+	char magic[4];				// Always DYNSTACK_FILE_MAGIC (not null terminated)
+	uint32_t version;			// Always DYNSTACK_FILE_VERSION
+	uint64_t count;				// Number of records following the header
+	uint64_t payloadBytes;		// Total size of every record payload, excluding lengths
+} DynFileHeader;
+
 /*
  * This stack implementation is a "Linked List Stack" (often abbreviated to "Linked Stack"),
  * which uses a singly-linked list to store a collection of elements.
@@ -27,15 +72,85 @@ typedef struct dynamicStackFrame {
 	struct dynamicStackFrame *next;
 } DynFrame;
 
+/*
+ * Position in a stack returned by `dynstackMark`, to be passed to `dynstackRewind`.
+ * It is the number of elements that were in the stack when the mark was taken.
+ */
+typedef size_t DynMark;
+
+/*
+ * A free list of frames that are ready to be reused, which can be shared by several stacks.
+ * Stacks using a pool take frames from it before allocating new ones, and give their frames
+ * back to it instead of freeing them.
+ *
+ * A pool isn't synchronized, so every stack sharing it must be used from the same thread.
+ *
+ * A locked pool (see `dynstackPoolNewLocked`) lives at the start of a block of locked memory
+ * holding all of its initial frames. Those frames were never malloc'd, so they must only ever
+ * be given back to a pool, never freed.
+ */
+typedef struct dynamicFramePool {
+	DynFrame *frames;			// Frames ready to be reused
+	size_t count;				// Number of frames in `frames`
+	size_t allocations;			// Number of frames allocated for the pool after its creation
+	size_t blockSize;			// Bytes of locked memory starting at the pool, or 0 if not locked
+} DynFramePool;
+
+/*
+ * A pending `dynstackAwaitPop` call, waiting for an element to be pushed.
+ *
+ * The storage belongs to the caller (typically the frame of the coroutine that is waiting),
+ * so registering a waiter never allocates. `callback` and `arg` must be set before the
+ * waiter is registered; the other fields are managed by the stack.
+ */
+typedef struct dynamicStackWaiter {
+	void (*callback)(void *data, void *arg);	// Called with the element handed to the waiter
+	void *arg;					// Passed through to `callback`
+	void *data;					// Element handed to the waiter (set before `callback` runs)
+	struct dynamicStackWaiter *next;
+} DynWaiter;
+
+/*
+ * Result of `dynstackAwaitPop`.
+ */
+typedef enum dynamicStackAwait {
+	DYNSTACK_AWAIT_READY,		// An element was popped right away
+	DYNSTACK_AWAIT_PENDING,		// The waiter was registered and will be called later
+	DYNSTACK_AWAIT_ERROR		// The arguments were invalid
+} DynAwait;
+
 /*
  * Metadata top of the stack. 
  * Contains the function pointers for working with the abstracted stack data.
+ *
+ * The fields written by every push and pop (including the lock) fill the struct's first cache
+ * line, and the read-mostly flags and function pointers are padded onto the second one, so
+ * threads reading those don't keep stealing the line from the thread holding the lock.
+ * That only holds if the struct starts on a cache line boundary, which DYNSTACK_ALIGNED
+ * guarantees; storage given to `dynstackInit` (a plain array of DynStacks, say) only has
+ * the alignment its owner gives it.
+ * `flags` is never written once the stack is set up, since it is read without the lock;
+ * anything that changes later (such as `ownsPool`) is only used with the stack locked.
+ *
+ * The struct ends with a few frames of its own. Pushes use them before anything else, so
+ * a stack that never holds more than DYNSTACK_INLINE_FRAMES elements never allocates a frame.
  */
 typedef struct dynamicStack {
 	DynFrame *top;				// Stack frame at the top of the stack
-	unsigned int size;			// Number of stack frames in the stack
+	size_t size;				// Number of stack frames in the stack
+	DynFrame *inlineFree;		// Inline frames ready to be used
+	size_t inlineUsed;			// Number of `inlineFrames` currently out of `inlineFree`
+	DynWaiter *waitHead;		// Oldest waiter registered by `dynstackAwaitPop`
+	DynWaiter *waitTail;		// Newest waiter registered by `dynstackAwaitPop`
+	int lock;					// Spinlock guarding the stack, if it is DYNSTACK_THREADSAFE
+	bool ownsPool;				// Whether `pool` was made for the stack and is freed with it
+	char hotPadding[DYNSTACK_CACHE_LINE - 4 * sizeof(void *) - 2 * sizeof(size_t) - sizeof(int) - sizeof(bool)];
+	DynFramePool *pool;			// Where frames are recycled, or NULL to use malloc/free directly
 	void (*deleteData)(void *);	// Function pointer to free an element in the stack
 	char *(*printData)(void *);	// Function pointer to create a string from a stack element
+	unsigned int flags;			// DYNSTACK_* flags the stack was created with
+	char readPadding[DYNSTACK_CACHE_LINE - 3 * sizeof(void *) - sizeof(unsigned int)];
+	DynFrame inlineFrames[DYNSTACK_INLINE_FRAMES];	// Frames stored inside the struct itself
 } DynStack;
 
 
@@ -43,10 +158,15 @@ typedef struct dynamicStack {
  * FUNCTIONS *
  *************/
 
+/*
+ * Returns the DYNSTACK_ABI_VERSION the library was compiled with.
+ */
+unsigned int dynstackAbiVersion(void);
+
+
 /*
  * Function to initialize the DynStack metadata head to the appropriate function pointers.
- * Allocates memory to the struct, unless any of the function pointers are NULL. In this
- * case, NULL is returned instead and no memory is allocated.
+ * Allocates memory to the struct, and returns NULL if that isn't possible.
  *
  * The DynStack provides an interface to a generic collection of data. The two 
  * function pointers allow the struct to print and delete its data.
@@ -56,11 +176,66 @@ typedef struct dynamicStack {
  *  char *printFunc(void *toPrint)  : return a string representation of `toPrint`
  *  void deleteFunc(void *toDelete) : free all memory associated with `toDelete`
  *
+ * Either function pointer may be NULL. A stack without `deleteFunc` doesn't own its elements
+ * (as if it were created with DYNSTACK_BORROWED) and never deletes them. A stack without
+ * `printFunc` prints the number of elements instead of the elements themselves.
+ *
  * Examples of these functions are provided for string (char *) data in the README.
  */
 DynStack *dynstackNew(void (*deleteFunc)(void *), char *(*printFunc)(void *));
 
 
+/*
+ * Identical to `dynstackNew`, except that the new stack's behaviour is changed by `flags`,
+ * a bitwise OR of any of the following:
+ *
+ *  DYNSTACK_THREADSAFE : every function in this file may be called on the stack from several
+ *                        threads at once. The stack embeds a spinlock which is held only for
+ *                        the few instructions that touch the stack itself, so frames are still
+ *                        allocated, freed and deleted outside of it. `dynstackMap`, the
+ *                        string/output functions and `dynstackSave` hold the lock while they
+ *                        call back into `func`/`printData`/`serializeFunc`, so those callbacks
+ *                        must not use the same stack. The functions writing to a file copy
+ *                        the stack's records while locked, and only do the I/O once the stack
+ *                        is unlocked.
+ *  DYNSTACK_BORROWED   : the elements belong to someone else, so `deleteData` is never called.
+ *                        Clearing the stack (or rewinding or trimming it) only releases frames,
+ *                        without visiting the elements one by one to delete them.
+ *  DYNSTACK_TRIVIAL    : the elements don't need to be deleted (for example small integers
+ *                        cast to pointers), which is treated exactly like DYNSTACK_BORROWED.
+ *  DYNSTACK_ALIGNED    : the DynStack struct is allocated on a cache line boundary and given
+ *                        whole cache lines, so stacks used by different threads (typically one
+ *                        per worker) never share a cache line and don't slow each other down.
+ */
+DynStack *dynstackNewFlags(void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags);
+
+
+/*
+ * Identical to `dynstackNewFlags`, except that the stack is set up in storage provided by the
+ * caller (typically a member of a larger struct, or a local variable) instead of being
+ * allocated. Returns false if `stack` is NULL. DYNSTACK_ALIGNED has no effect here, since
+ * the caller decides where the storage is: unless it starts on a cache line boundary, the
+ * stack's lines are shared with its neighbours (the previous and next DynStack in an array).
+ *
+ * The stack's inline frames point into the struct, so it must not be moved or copied while
+ * it is in use. It is torn down with `dynstackDestroy`, not `dynstackFree`.
+ */
+bool dynstackInit(DynStack *stack, void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags);
+
+
+/*
+ * Allocates a DYNSTACK_REALTIME stack with room for `budget` elements, whose frames are
+ * allocated up front in memory that is already paged in and locked in RAM (see
+ * `dynstackPoolNewLocked`). Pushes and pops never call malloc/free or fault on a page,
+ * so their worst-case latency is bounded; a push beyond the budget fails instead.
+ *
+ * Returns NULL if memory can't be allocated or locked; locking is limited by RLIMIT_MEMLOCK.
+ * `flags` are the same as for `dynstackNewFlags`. The DynStack struct itself is ordinary
+ * memory, so callers that can't afford even that page being swapped out should `mlockall`.
+ */
+DynStack *dynstackNewRealtime(void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags, size_t budget);
+
+
 /*
  * Allocates memory for a new DynFrame struct and returns a pointer to it.
  */
@@ -80,19 +255,42 @@ void dynstackFree(DynStack *stack);
 
 
 /*
- * Pushes the data to the top of the stack.
+ * Frees all memory associated with a stack set up by `dynstackInit`, but not the storage
+ * of the stack itself. The storage can be given to `dynstackInit` again afterwards.
+ */
+void dynstackDestroy(DynStack *stack);
+
+
+/*
+ * Pushes the data to the top of the stack, or hands it straight to the oldest waiter
+ * registered by `dynstackAwaitPop` if there is one.
  * If the push operation can't be completed for whatever reason,
  * this function returns `false`. Otherwise, it returns `true` for a
  * successful push.
  *
- * `false` may be returned if `stack` is NULL, or if memory can't
- * be allocated to create a new DynStackFrame. Both of these scenarios
+ * `false` may be returned if `stack` is NULL, if memory can't
+ * be allocated to create a new DynStackFrame, or if the stack already holds
+ * SIZE_MAX elements (so its size can't wrap around). All of these scenarios
  * are incredibly unlikely; assuming proper use of the functions
  * in this library and sufficient memory is available to the system.
  */
 bool dynstackPush(DynStack *stack, void *data);
 
 
+/*
+ * Pushes a chain of `count` frames, linked from `top` down to `bottom` through their
+ * `next` pointers, onto the stack in one step. `top` ends up at the top of the stack.
+ *
+ * The frames must have been created by `dynstackFrameNew`, and the stack takes ownership
+ * of them. Elements from the top of the chain are handed to registered waiters first.
+ * Nothing is done if `stack`, `top` or `bottom` is NULL.
+ *
+ * Returns false without taking the frames if the stack's size would wrap around past
+ * SIZE_MAX, or if any argument is NULL; the caller still owns the chain then.
+ */
+bool dynstackPushChain(DynStack *stack, DynFrame *top, DynFrame *bottom, size_t count);
+
+
 /*
  * Returns the top of the stack without removing it.
  */
@@ -105,10 +303,165 @@ void *dynstackPeek(const DynStack *stack);
 void *dynstackPop(DynStack *stack);
 
 
+/*
+ * Pops the top of the stack without ever blocking, for use by coroutine/async runtimes.
+ *
+ * If the stack isn't empty, the top is popped into `data` and DYNSTACK_AWAIT_READY is
+ * returned. Otherwise `waiter` is registered and DYNSTACK_AWAIT_PENDING is returned; the
+ * next push hands its element directly to the oldest registered waiter (without it ever
+ * entering the stack) by calling `waiter->callback(element, waiter->arg)` from the pushing
+ * thread, after the stack has been unlocked.
+ *
+ * `waiter` must stay valid until its callback runs or it is cancelled. Waiters still
+ * registered when the stack is freed are never called.
+ */
+DynAwait dynstackAwaitPop(DynStack *stack, void **data, DynWaiter *waiter);
+
+
+/*
+ * Unregisters a waiter that hasn't been handed an element yet.
+ * Returns true if it was removed, and false if it wasn't registered (for example because
+ * its callback has already been called, or is about to be called by another thread).
+ */
+bool dynstackCancelAwait(DynStack *stack, DynWaiter *waiter);
+
+
+/*
+ * Deletes an element that has been removed from the stack using the stack's `deleteData`
+ * function pointer, unless the stack doesn't own its elements (see DYNSTACK_BORROWED).
+ */
+void dynstackDeleteData(const DynStack *stack, void *data);
+
+
+/*
+ * Removes every frame from the stack in one step, without deleting their data, and returns
+ * the first of them (the former top). The caller owns the returned chain, and should give
+ * its frames back with `dynstackReleaseFrames` once it is done with the data. Some of them
+ * may be the stack's inline frames, so they can't be given to any other stack, and must be
+ * given back before the stack is freed.
+ */
+DynFrame *dynstackDetachAll(DynStack *stack);
+
+
+/*
+ * Gives every frame of a detached chain starting at `top` back to the stack's frame pool
+ * (in one splice), or frees them if the stack doesn't use a pool. Their data isn't deleted.
+ */
+void dynstackReleaseFrames(DynStack *stack, DynFrame *top);
+
+
+/*
+ * Acquires the lock of a DYNSTACK_THREADSAFE stack, for code that walks the stack's frames
+ * directly. Does nothing for other stacks. The lock isn't recursive, so no other function
+ * in this file may be called on the stack until `dynstackUnlock`.
+ */
+void dynstackLock(const DynStack *stack);
+
+
+/*
+ * Releases the lock acquired by `dynstackLock`.
+ */
+void dynstackUnlock(const DynStack *stack);
+
+
+/*
+ * Returns a mark for the current top of the stack, for example the start of a scope.
+ */
+DynMark dynstackMark(const DynStack *stack);
+
+
+/*
+ * Removes every element pushed since `mark` was taken, in one operation.
+ *
+ * The discarded frames are cut off the stack in one step, their data is deleted in a
+ * single loop outside of the stack's lock, and the frames are then released together (a
+ * frame pool takes them back with one splice). Returns false, without changing anything,
+ * if `stack` is NULL or has already been popped below `mark`.
+ */
+bool dynstackRewind(DynStack *stack, DynMark mark);
+
+
+/*
+ * Keeps only the top `keep` elements of the stack, deleting every older element below them
+ * in one operation (the same way as `dynstackRewind`). Useful for bounding a history.
+ * Returns false if `stack` is NULL.
+ */
+bool dynstackTrim(DynStack *stack, size_t keep);
+
+
+/*
+ * Moves the top element of `from` to the top of `to` by relinking its frame, without
+ * allocating or freeing anything. Returns false if either stack is NULL, `from` is empty,
+ * or `to` already holds SIZE_MAX elements, in which case the element stays in `from`.
+ *
+ * An element held in one of `from`'s inline frames can't leave the struct, so it is copied
+ * into a new frame of `to` instead, which may have to be allocated; false is returned,
+ * leaving both stacks untouched, if that fails.
+ *
+ * Both stacks must use the same frame pool (or none at all).
+ */
+bool dynstackMoveTop(DynStack *from, DynStack *to);
+
+
+/*
+ * Allocates an empty frame pool. Returns NULL if memory can't be allocated.
+ */
+DynFramePool *dynstackPoolNew(void);
+
+
+/*
+ * Allocates a pool holding at least `count` frames, all carved out of a single block of
+ * memory that is touched and locked in RAM before returning, so taking frames from the pool
+ * never faults. Returns NULL if the memory can't be allocated or locked.
+ *
+ * Stacks using a locked pool must keep using it for as long as they hold its frames.
+ */
+DynFramePool *dynstackPoolNewLocked(size_t count);
+
+
+/*
+ * Frees every frame held by the pool, and the pool itself.
+ * No stack may still be using the pool.
+ */
+void dynstackPoolFree(DynFramePool *pool);
+
+
+/*
+ * Makes the stack take its frames from `pool` and give them back to it, or go back to
+ * allocating and freeing every frame if `pool` is NULL. Frames already in the stack don't
+ * have to come from the pool, but frames from a locked pool can't go back to malloc/free.
+ *
+ * Returns false, changing nothing, if `stack` is NULL or DYNSTACK_REALTIME: a real-time
+ * stack keeps the locked pool it was created with until it is freed.
+ */
+bool dynstackSetPool(DynStack *stack, DynFramePool *pool);
+
+
+/*
+ * Makes sure the next `count` pushes onto the stack won't need to allocate, by filling its
+ * frame pool with at least `count` frames. A stack without a pool is given a private one,
+ * which is freed along with the stack. Returns false if memory can't be allocated, in which
+ * case the frames allocated so far stay in the pool, or if the stack is DYNSTACK_REALTIME
+ * (its locked pool is sized once, by `dynstackNewRealtime`).
+ *
+ * If the pool is shared, the reserved frames can be taken by any stack sharing it.
+ * Comparing the pool's `allocations` before and after a section of code tells whether
+ * anything in it had to allocate a frame.
+ */
+bool dynstackReserve(DynStack *stack, size_t count);
+
+
+/*
+ * Pushes an element onto the stack using one of its inline frames or a frame from its pool,
+ * and never allocates. Returns false, leaving the stack untouched, if there is no such frame.
+ */
+bool dynstackPushNoAlloc(DynStack *stack, void *data);
+
+
 /*
  * Returns the number of elements in the stack.
  */
-unsigned int dynstackGetSize(const DynStack *stack);
+size_t dynstackGetSize(const DynStack *stack);
 
 
 /*
@@ -151,11 +504,98 @@ char *dynstackToString(const DynStack *stack);
 void dynstackPrint(const DynStack *stack);
 
 
+/*
+ * Returns a string representing the elements of the DynStack at positions `from` (inclusive)
+ * to `to` (exclusive), where position 0 is the top of the stack, in the same format as
+ * `dynstackToString`. Positions past the bottom of the stack are ignored.
+ *
+ * Only the frames down to position `to` are visited, so the cost depends on the size of
+ * the range rather than the size of the stack.
+ *
+ * The string must be freed by the calling function after use.
+ */
+char *dynstackToStringRange(const DynStack *stack, size_t from, size_t to);
+
+
+/*
+ * Returns a string representing the top `n` elements of the DynStack, in the same format
+ * as `dynstackToString`. Equivalent to `dynstackToStringRange(stack, 0, n)`.
+ *
+ * The string must be freed by the calling function after use.
+ */
+char *dynstackToStringN(const DynStack *stack, size_t n);
+
+
+/*
+ * A convenient alias for printing the string returned by `dynstackToStringRange(stack, from, to)`
+ * and then freeing the string that was created after printing it.
+ * A newline is printed after the range-string is done printing.
+ */
+void dynstackPrintRange(const DynStack *stack, size_t from, size_t to);
+
+
+/*
+ * Writes the stack to `fp` as a JSON array of strings, starting from the top of the stack
+ * and working downwards. Each element is converted with the stack's `printData` function
+ * pointer and escaped as it is written, so no string holding the whole stack is ever built
+ * (a DYNSTACK_THREADSAFE stack's element strings are all made before writing, however).
+ *
+ * Returns false if `stack` or `fp` is NULL, the stack has no `printData`, or if writing fails.
+ */
+bool dynstackWriteJSON(const DynStack *stack, FILE *fp);
+
+
+/*
+ * Writes the stack to `fp` as a sequence of netstrings (`<length>:<bytes>,`), starting from
+ * the top of the stack and working downwards. Unlike `dynstackToString`, element strings may
+ * contain newlines (or any other byte) since every one of them is prefixed with its length.
+ *
+ * Returns false if `stack` or `fp` is NULL, the stack has no `printData`, or if writing fails.
+ */
+bool dynstackWriteDelimited(const DynStack *stack, FILE *fp);
+
+
 /*
  * Execute a function `func` on each element in the stack
  * starting from the top and working downwards.
  */
 void dynstackMap(DynStack *stack, void (*func)(void *));
 
+
+/*
+ * Writes every element of the stack to the file `filename` in the binary format
+ * described by DynFileHeader, replacing the file if it already exists.
+ * Returns `true` if the whole stack was written, and `false` otherwise.
+ *
+ * The (void *) argument of `serializeFunc` is to be casted into the stack's data type:
+ *
+ *  void *serializeFunc(void *toSave, size_t *length) : return a malloc'd buffer holding
+ *                                                      `toSave` and store its size in `length`
+ *
+ * Small records are gathered into a buffer of DYNSTACK_IO_BUFFER_SIZE bytes so that the
+ * file is written with a few large writes instead of one per element.
+ *
+ * The stack is first written to `filename` with ".tmp" appended, which is flushed to disk
+ * and then renamed over `filename`, so the previous file is kept intact if saving fails.
+ * Making the rename itself survive a power failure needs the directory to be fsync'd.
+ */
+bool dynstackSave(const DynStack *stack, const char *filename, void *(*serializeFunc)(void *, size_t *));
+
+
+/*
+ * Creates a new DynStack holding the elements of a file written by `dynstackSave`,
+ * in the same order they had when they were saved.
+ * Returns NULL if the file can't be read, isn't a DynStack file, or if memory can't
+ * be allocated; `deleteFunc` and `printFunc` are the same as in `dynstackNew`.
+ *
+ *  void *deserializeFunc(const void *buffer, size_t length) : return a new element
+ *                                                             created from `buffer`
+ *
+ * Every record is read into a single allocation with one read, rather than one read
+ * (and one allocation) per element.
+ */
+DynStack *dynstackLoad(const char *filename, void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*deserializeFunc)(const void *, size_t));
+
 #endif	// DYNSTACK_H
 
@@ -0,0 +1,144 @@
+#ifndef DYNSTACKDEFINE_H
+#define DYNSTACKDEFINE_H
+
+#include "DynStack.h"
+
+/*
+ * DYNSTACK_DEFINE(name, T, deleteFunc, printFunc)
+ *
+ * Defines a family of functions, all prefixed with `name`, for DynStacks holding elements of
+ * the pointer type `T`. `deleteFunc` and `printFunc` are named at compile time instead of
+ * being called through the stack's function pointers, so the compiler can inline them into
+ * the loops of the Clear/ToString/Map functions below.
+ *
+ *  void deleteFunc(T toDelete) : free all memory associated with `toDelete`
+ *  char *printFunc(T toPrint)  : return a string representation of `toPrint`
+ *
+ * The stacks are ordinary DynStacks, so the generic functions in DynStack.h work on them too.
+ * Given `DYNSTACK_DEFINE(strStack, char *, freeString, copyString)`, the generated functions are:
+ *
+ *  DynStack *strStackNew(unsigned int flags)              : `dynstackNewFlags` with the functions above
+ *  bool strStackInit(DynStack *stack, unsigned int flags) : `dynstackInit` with the functions above
+ *  void strStackClear(DynStack *stack)                    : `dynstackClear`
+ *  void strStackFree(DynStack *stack)                     : `dynstackFree`
+ *  void strStackDestroy(DynStack *stack)                  : `dynstackDestroy`
+ *  bool strStackPush(DynStack *stack, char *data)         : `dynstackPush`
+ *  char *strStackPeek(const DynStack *stack)              : `dynstackPeek`
+ *  char *strStackPop(DynStack *stack)                     : `dynstackPop`
+ *  char *strStackToString(const DynStack *stack)          : `dynstackToString`
+ *  void strStackPrint(const DynStack *stack)              : `dynstackPrint`
+ *  void strStackMap(DynStack *stack, void (*)(char *))    : `dynstackMap`, which is inlined along
+ *                                                           with `func` when `func` is a constant
+ *
+ * Everything is `static inline`, so the macro can be used in a header.
+ */
+#define DYNSTACK_DEFINE(name, T, deleteFunc, printFunc) \
+	\
+	static inline void name##DeleteData(void *data) { \
+		deleteFunc((T)data); \
+	} \
+	\
+	static inline char *name##PrintData(void *data) { \
+		return printFunc((T)data); \
+	} \
+	\
+	static inline DynStack *name##New(unsigned int flags) { \
+		return dynstackNewFlags(name##DeleteData, name##PrintData, flags); \
+	} \
+	\
+	static inline bool name##Init(DynStack *stack, unsigned int flags) { \
+		return dynstackInit(stack, name##DeleteData, name##PrintData, flags); \
+	} \
+	\
+	static inline void name##Clear(DynStack *stack) { \
+		DynFrame *chain = dynstackDetachAll(stack); \
+		if (chain != NULL && !(stack->flags & (DYNSTACK_BORROWED | DYNSTACK_TRIVIAL))) { \
+			for (DynFrame *cur = chain; cur != NULL; cur = cur->next) { \
+				deleteFunc((T)cur->data); \
+			} \
+		} \
+		dynstackReleaseFrames(stack, chain); \
+	} \
+	\
+	static inline void name##Free(DynStack *stack) { \
+		name##Clear(stack); \
+		dynstackFree(stack); \
+	} \
+	\
+	static inline void name##Destroy(DynStack *stack) { \
+		name##Clear(stack); \
+		dynstackDestroy(stack); \
+	} \
+	\
+	static inline bool name##Push(DynStack *stack, T data) { \
+		return dynstackPush(stack, (void *)data); \
+	} \
+	\
+	static inline T name##Peek(const DynStack *stack) { \
+		return (T)dynstackPeek(stack); \
+	} \
+	\
+	static inline T name##Pop(DynStack *stack) { \
+		return (T)dynstackPop(stack); \
+	} \
+	\
+	static inline char *name##ToString(const DynStack *stack) { \
+		if (stack == NULL) { \
+			return NULL; \
+		} \
+		size_t length = 0; \
+		size_t capacity = 64; \
+		char *toReturn = malloc(capacity); \
+		if (toReturn == NULL) { \
+			return NULL; \
+		} \
+		toReturn[0] = '\0'; \
+		dynstackLock(stack); \
+		for (DynFrame *cur = stack->top; cur != NULL; cur = cur->next) { \
+			char *frameStr = printFunc((T)cur->data); \
+			size_t frameLength = strlen(frameStr); \
+			if (length + frameLength + 2 > capacity) { \
+				while (length + frameLength + 2 > capacity) { \
+					capacity *= 2; \
+				} \
+				char *grown = realloc(toReturn, capacity); \
+				if (grown == NULL) { \
+					dynstackUnlock(stack); \
+					free(frameStr); \
+					free(toReturn); \
+					return NULL; \
+				} \
+				toReturn = grown; \
+			} \
+			if (cur != stack->top) { \
+				toReturn[length++] = '\n'; \
+			} \
+			memcpy(toReturn + length, frameStr, frameLength + 1); \
+			length += frameLength; \
+			free(frameStr); \
+		} \
+		dynstackUnlock(stack); \
+		return toReturn; \
+	} \
+	\
+	static inline void name##Print(const DynStack *stack) { \
+		if (stack == NULL) { \
+			return; \
+		} \
+		char *toPrint = name##ToString(stack); \
+		printf("%s\n", toPrint); \
+		free(toPrint); \
+	} \
+	\
+	static inline void name##Map(DynStack *stack, void (*func)(T)) { \
+		if (stack == NULL) { \
+			return; \
+		} \
+		dynstackLock(stack); \
+		for (DynFrame *cur = stack->top; cur != NULL; cur = cur->next) { \
+			func((T)cur->data); \
+		} \
+		dynstackUnlock(stack); \
+	}
+
+#endif	// DYNSTACKDEFINE_H
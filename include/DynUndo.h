@@ -0,0 +1,103 @@
+#ifndef DYNUNDO_H
+#define DYNUNDO_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "DynStack.h"
+
+/**************
+ * STRUCTURES *
+ **************/
+
+/*
+ * An operation recorded in an undo history, along with what it costs to keep around.
+ */
+typedef struct dynamicUndoEntry {
+	void *op;					// The recorded operation
+	size_t cost;				// Bytes charged against the history's budget
+	void (*deleteOp)(void *);	// Function pointer to free the operation
+} DynUndoEntry;
+
+/*
+ * An undo/redo history built from two DynStacks.
+ *
+ * Undoing or redoing moves the frame holding the operation from one stack to the other,
+ * so neither allocates. The history's memory is bounded by `budget`: once recording an
+ * operation goes over budget, the oldest operations are evicted in a single batch until
+ * the history is down to three quarters of its budget, so evictions stay rare.
+ */
+typedef struct dynamicUndoHistory {
+	DynStack *undo;				// Operations that can be undone, most recent on top
+	DynStack *redo;				// Operations that were undone, most recent on top
+	size_t budget;				// Maximum number of bytes kept in the history
+	size_t used;				// Bytes currently charged against the budget
+	void (*deleteOp)(void *);	// Function pointer to free an operation
+	bool (*coalesceOp)(void *, void *);	// Function pointer to merge two operations
+} DynUndo;
+
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Creates an empty history that keeps at most `budget` bytes of operations.
+ * The (void *) arguments of the function pointers are recorded operations:
+ *
+ *  void deleteFunc(void *toDelete)             : free all memory associated with `toDelete`
+ *  bool coalesceFunc(void *previous, void *op) : merge `op` into `previous` if they can be
+ *                                                undone as one, and return whether they were
+ *
+ * `coalesceFunc` may be NULL, in which case operations are never merged.
+ * Returns NULL if `deleteFunc` is NULL or memory can't be allocated.
+ */
+DynUndo *dynstackUndoNew(size_t budget, void (*deleteFunc)(void *), bool (*coalesceFunc)(void *, void *));
+
+
+/*
+ * Frees every recorded operation and the history itself.
+ */
+void dynstackUndoFree(DynUndo *history);
+
+
+/*
+ * Records an operation that was just performed, costing `cost` bytes, and forgets every
+ * operation that could have been redone.
+ *
+ * If the previous operation can absorb this one (according to the coalesce function),
+ * `op` is merged into it and deleted, so a run of small operations is undone in one step.
+ * Returns false if `history` or `op` is NULL, or if memory can't be allocated (in which
+ * case `op` is deleted).
+ */
+bool dynstackUndoRecord(DynUndo *history, void *op, size_t cost);
+
+
+/*
+ * Moves the most recent operation onto the redo stack and returns it, so that the caller
+ * can revert it. Returns NULL if there is nothing to undo.
+ */
+void *dynstackUndo(DynUndo *history);
+
+
+/*
+ * Moves the most recently undone operation back onto the undo stack and returns it, so
+ * that the caller can perform it again. Returns NULL if there is nothing to redo.
+ */
+void *dynstackRedo(DynUndo *history);
+
+
+/*
+ * Returns true if there is an operation to undo, and false otherwise.
+ */
+bool dynstackCanUndo(const DynUndo *history);
+
+
+/*
+ * Returns true if there is an operation to redo, and false otherwise.
+ */
+bool dynstackCanRedo(const DynUndo *history);
+
+#endif	// DYNUNDO_H
@@ -0,0 +1,58 @@
+#ifndef DYNVMEM_H
+#define DYNVMEM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*************
+ * FUNCTIONS *
+ *************/
+
+/*
+ * Helpers for stacks that manage their own virtual memory: address space is reserved
+ * inaccessible up front, and parts of it are made usable (committed) afterwards. Reserved
+ * pages that were never committed cost no physical memory, and touching one faults.
+ */
+
+/*
+ * Returns the size of a page of virtual memory, in bytes.
+ */
+size_t dynstackPageSize(void);
+
+
+/*
+ * Rounds `size` up to a whole number of pages.
+ */
+size_t dynstackPageRound(size_t size);
+
+
+/*
+ * Reserves `size` bytes of inaccessible address space and returns its start (which is page
+ * aligned), or NULL if the reservation fails. `size` must be a whole number of pages.
+ */
+void *dynstackVMemReserve(size_t size);
+
+
+/*
+ * Makes `size` bytes starting at `addr`, within a reservation, readable and writable.
+ * Both must be page aligned. Returns false if the pages can't be committed.
+ */
+bool dynstackVMemCommit(void *addr, size_t size);
+
+
+/*
+ * Touches every page of `size` committed bytes starting at `addr`, so they are backed by
+ * physical memory, and locks them in RAM so they are never paged out. Both must be page
+ * aligned. Returns false if the pages can't be locked (see RLIMIT_MEMLOCK).
+ */
+bool dynstackVMemLock(void *addr, size_t size);
+
+
+/*
+ * Releases a whole reservation made by `dynstackVMemReserve`.
+ */
+void dynstackVMemRelease(void *addr, size_t size);
+
+#endif	// DYNVMEM_H
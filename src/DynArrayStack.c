@@ -0,0 +1,155 @@
+#include "DynArrayStack.h"
+#include "DynVMem.h"
+
+
+/*
+ * Commits twice as many slots as are committed now (without leaving the reservation).
+ * Elements already in the stack stay where they are.
+ */
+static bool growCommitted(DynArrayStack *stack) {
+	if (stack->committed == stack->reserved) {
+		return false;
+	}
+
+	size_t newCommitted = stack->committed * 2;
+	if (stack->committed == 0) {
+		newCommitted = DYNARRAY_INITIAL_COMMIT / sizeof(void *);
+	}
+	if (newCommitted > stack->reserved) {
+		newCommitted = stack->reserved;
+	}
+
+	if (!dynstackVMemCommit(stack->slots + stack->committed, (newCommitted - stack->committed) * sizeof(void *))) {
+		return false;
+	}
+
+	stack->committed = newCommitted;
+	return true;
+}
+
+
+DynArrayStack *dynstackArrayNew(void (*deleteFunc)(void *), char *(*printFunc)(void *), size_t maxCapacity) {
+	if (maxCapacity > SIZE_MAX / sizeof(void *)) {
+		return NULL;
+	}
+
+	DynArrayStack *toReturn = malloc(sizeof(DynArrayStack));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	if (maxCapacity == 0) {
+		maxCapacity = DYNARRAY_DEFAULT_RESERVE;
+	}
+
+	// The reservation is rounded up to whole pages, so every page of it can be committed
+	size_t reservedBytes = dynstackPageRound(maxCapacity * sizeof(void *));
+	toReturn->slots = dynstackVMemReserve(reservedBytes);
+	if (toReturn->slots == NULL) {
+		free(toReturn);
+		return NULL;
+	}
+
+	toReturn->size = 0;
+	toReturn->committed = 0;
+	toReturn->reserved = reservedBytes / sizeof(void *);
+	toReturn->deleteData = deleteFunc;
+	toReturn->printData = printFunc;
+
+	return toReturn;
+}
+
+
+void dynstackArrayClear(DynArrayStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	// Elements the stack doesn't own are left alone, so there is nothing to walk
+	if (stack->deleteData == NULL) {
+		stack->size = 0;
+		return;
+	}
+
+	while (stack->size > 0) {
+		stack->deleteData(stack->slots[--(stack->size)]);
+	}
+}
+
+
+void dynstackArrayFree(DynArrayStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	dynstackArrayClear(stack);
+	dynstackVMemRelease(stack->slots, stack->reserved * sizeof(void *));
+	free(stack);
+}
+
+
+bool dynstackArrayPush(DynArrayStack *stack, void *data) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	if (stack->size == stack->committed && !growCommitted(stack)) {
+		return false;
+	}
+
+	stack->slots[(stack->size)++] = data;
+	return true;
+}
+
+
+void *dynstackArrayPeek(const DynArrayStack *stack) {
+	if (stack == NULL || stack->size == 0) {
+		return NULL;
+	}
+
+	return stack->slots[stack->size - 1];
+}
+
+
+void *dynstackArrayPop(DynArrayStack *stack) {
+	if (stack == NULL || stack->size == 0) {
+		return NULL;
+	}
+
+	return stack->slots[--(stack->size)];
+}
+
+
+void **dynstackArraySlot(DynArrayStack *stack, size_t n) {
+	if (stack == NULL || n >= stack->size) {
+		return NULL;
+	}
+
+	return &(stack->slots[stack->size - 1 - n]);
+}
+
+
+size_t dynstackArrayGetSize(const DynArrayStack *stack) {
+	if (stack == NULL) {
+		return 0;
+	}
+	return stack->size;
+}
+
+
+bool dynstackArrayIsEmpty(const DynArrayStack *stack) {
+	return dynstackArrayGetSize(stack) == 0;
+}
+
+
+void dynstackArrayMap(DynArrayStack *stack, void (*func)(void *)) {
+	if (stack == NULL) {
+		return;
+	}
+
+	for (size_t i = stack->size; i > 0; i--) {
+		func(stack->slots[i - 1]);
+	}
+}
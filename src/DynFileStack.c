@@ -0,0 +1,266 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DynFileStack.h"
+
+
+// Records are padded to this many bytes so that every length field is aligned
+#define RECORD_ALIGN sizeof(uint64_t)
+
+#define HEADER(stack) ((DynFileStackHeader *)(stack)->map)
+
+
+static size_t padRecord(size_t length) {
+	return (length + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+
+/*
+ * Reads the trailer of the record ending at `top`, and checks that the record fits between
+ * the header and `top`. Returns false if it doesn't, or if there is no record there.
+ */
+static bool readTrailer(const DynFileStack *stack, uint64_t top, DynFileStackTrailer *trailer) {
+	if (top % RECORD_ALIGN != 0 || top > stack->mapSize
+			|| top < sizeof(DynFileStackHeader) + sizeof(DynFileStackTrailer)) {
+		return false;
+	}
+
+	memcpy(trailer, stack->map + top - sizeof(DynFileStackTrailer), sizeof(DynFileStackTrailer));
+
+	uint64_t room = top - sizeof(DynFileStackTrailer) - sizeof(DynFileStackHeader);
+	return trailer->count > 0 && trailer->length <= room && padRecord(trailer->length) <= room;
+}
+
+
+/*
+ * Applies the stack's sync policy to the `length` bytes starting at `offset`,
+ * which msync requires to begin on a page boundary. A failure is remembered
+ * until `dynstackFileSync` reports it.
+ */
+static bool syncRange(DynFileStack *stack, size_t offset, size_t length) {
+	if (stack->sync == DYNFILESTACK_SYNC_NONE) {
+		return true;
+	}
+
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t start = offset - (offset % pageSize);
+	int flags = (stack->sync == DYNFILESTACK_SYNC_ALWAYS) ? MS_SYNC : MS_ASYNC;
+
+	if (msync(stack->map + start, length + (offset - start), flags) != 0) {
+		stack->failed = true;
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ * Grows the file (and its mapping) to at least `needed` bytes.
+ */
+static bool growFile(DynFileStack *stack, size_t needed) {
+	size_t newSize = stack->mapSize;
+	while (newSize < needed) {
+		newSize *= 2;
+	}
+
+	if (ftruncate(stack->fd, (off_t)newSize) != 0) {
+		return false;
+	}
+
+	char *newMap = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, stack->fd, 0);
+	if (newMap == MAP_FAILED) {
+		return false;
+	}
+
+	munmap(stack->map, stack->mapSize);
+	stack->map = newMap;
+	stack->mapSize = newSize;
+	return true;
+}
+
+
+DynFileStack *dynstackFileOpen(const char *filename, DynFileSync sync) {
+	if (filename == NULL) {
+		return NULL;
+	}
+
+	DynFileStack *toReturn = malloc(sizeof(DynFileStack));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	toReturn->fd = open(filename, O_RDWR | O_CREAT, 0644);
+	if (toReturn->fd < 0) {
+		free(toReturn);
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(toReturn->fd, &info) != 0) {
+		close(toReturn->fd);
+		free(toReturn);
+		return NULL;
+	}
+
+	// A new (empty) file has to be sized before it can be mapped
+	bool created = (info.st_size == 0);
+	if (created) {
+		info.st_size = DYNFILESTACK_INITIAL_SIZE;
+		if (ftruncate(toReturn->fd, info.st_size) != 0) {
+			close(toReturn->fd);
+			free(toReturn);
+			return NULL;
+		}
+	} else if ((size_t)info.st_size < sizeof(DynFileStackHeader)) {
+		close(toReturn->fd);
+		free(toReturn);
+		return NULL;
+	}
+
+	toReturn->mapSize = (size_t)info.st_size;
+	toReturn->sync = sync;
+	toReturn->failed = false;
+	toReturn->map = mmap(NULL, toReturn->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, toReturn->fd, 0);
+	if (toReturn->map == MAP_FAILED) {
+		close(toReturn->fd);
+		free(toReturn);
+		return NULL;
+	}
+
+	DynFileStackHeader *header = HEADER(toReturn);
+	DynFileStackTrailer trailer;
+	if (created) {
+		memcpy(header->magic, DYNFILESTACK_MAGIC, sizeof(header->magic));
+		header->version = DYNFILESTACK_VERSION;
+		header->top = sizeof(DynFileStackHeader);
+		syncRange(toReturn, 0, sizeof(DynFileStackHeader));
+	} else if (memcmp(header->magic, DYNFILESTACK_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != DYNFILESTACK_VERSION
+			|| (header->top != sizeof(DynFileStackHeader) && !readTrailer(toReturn, header->top, &trailer))) {
+		munmap(toReturn->map, toReturn->mapSize);
+		close(toReturn->fd);
+		free(toReturn);
+		return NULL;
+	}
+
+	return toReturn;
+}
+
+
+void dynstackFileClose(DynFileStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	dynstackFileSync(stack);
+	munmap(stack->map, stack->mapSize);
+	close(stack->fd);
+	free(stack);
+}
+
+
+bool dynstackFileSync(DynFileStack *stack) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	bool failed = stack->failed;
+	stack->failed = false;
+	return msync(stack->map, stack->mapSize, MS_SYNC) == 0 && !failed;
+}
+
+
+bool dynstackFilePush(DynFileStack *stack, const void *record, size_t length) {
+	if (stack == NULL || (record == NULL && length > 0)) {
+		return false;
+	}
+
+	size_t start = HEADER(stack)->top;
+	size_t padded = padRecord(length);
+	size_t end = start + padded + sizeof(DynFileStackTrailer);
+	DynFileStackTrailer trailer = {length, dynstackFileGetSize(stack) + 1};
+
+	if (end > stack->mapSize && !growFile(stack, end)) {
+		return false;
+	}
+
+	// The record is completely written (and flushed, depending on the policy)
+	// before the top offset is moved, so a crash never exposes a partial record
+	memcpy(stack->map + start, record, length);
+	memcpy(stack->map + start + padded, &trailer, sizeof(trailer));
+	if (!syncRange(stack, start, end - start)) {
+		return false;
+	}
+
+	// A single store publishes the record, count included. If the new top can't be
+	// flushed, the old one is put back; either one on disk is a consistent stack.
+	__atomic_store_n(&(HEADER(stack)->top), end, __ATOMIC_RELEASE);
+	if (!syncRange(stack, 0, sizeof(DynFileStackHeader))) {
+		__atomic_store_n(&(HEADER(stack)->top), start, __ATOMIC_RELEASE);
+		return false;
+	}
+
+	return true;
+}
+
+
+const void *dynstackFilePeek(const DynFileStack *stack, size_t *length) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	// Records below the top haven't been checked since the stack was opened
+	size_t top = HEADER(stack)->top;
+	DynFileStackTrailer trailer;
+	if (top == sizeof(DynFileStackHeader) || !readTrailer(stack, top, &trailer)) {
+		return NULL;
+	}
+
+	if (length != NULL) {
+		*length = trailer.length;
+	}
+	return stack->map + top - sizeof(DynFileStackTrailer) - padRecord(trailer.length);
+}
+
+
+const void *dynstackFilePop(DynFileStack *stack, size_t *length) {
+	const void *toReturn = dynstackFilePeek(stack, length);
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	// Popping only moves the top offset; the record's bytes are left
+	// in the file until a later push overwrites them
+	uint64_t top = HEADER(stack)->top;
+	__atomic_store_n(&(HEADER(stack)->top), (uint64_t)((const char *)toReturn - stack->map), __ATOMIC_RELEASE);
+	if (!syncRange(stack, 0, sizeof(DynFileStackHeader))) {
+		__atomic_store_n(&(HEADER(stack)->top), top, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	return toReturn;
+}
+
+
+uint64_t dynstackFileGetSize(const DynFileStack *stack) {
+	if (stack == NULL) {
+		return 0;
+	}
+
+	DynFileStackTrailer trailer;
+	if (!readTrailer(stack, HEADER(stack)->top, &trailer)) {
+		return 0;
+	}
+	return trailer.count;
+}
+
+
+bool dynstackFileIsEmpty(const DynFileStack *stack) {
+	return dynstackFileGetSize(stack) == 0;
+}
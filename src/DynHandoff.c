@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "DynHandoff.h"
+
+
+DynHandoff *dynstackHandoffNew(void) {
+	void *aligned = NULL;
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (posix_memalign(&aligned, DYNSTACK_CACHE_LINE, sizeof(DynHandoff)) != 0) {
+		return NULL;
+	}
+	DynHandoff *toReturn = aligned;
+
+	toReturn->shared = NULL;
+	toReturn->kept = NULL;
+	toReturn->batch = NULL;
+	toReturn->batchBottom = NULL;
+	toReturn->batchSize = 0;
+
+	return toReturn;
+}
+
+
+static void freeChain(DynFrame *cur, void (*deleteFunc)(void *)) {
+	while (cur != NULL) {
+		DynFrame *next = cur->next;
+		if (deleteFunc != NULL) {
+			deleteFunc(cur->data);
+		}
+		free(cur);
+		cur = next;
+	}
+}
+
+
+void dynstackHandoffFree(DynHandoff *handoff, void (*deleteFunc)(void *)) {
+	if (handoff == NULL) {
+		return;
+	}
+
+	freeChain(handoff->batch, deleteFunc);
+	freeChain(handoff->shared, deleteFunc);
+	freeChain(handoff->kept, deleteFunc);
+	free(handoff);
+}
+
+
+bool dynstackHandoffPush(DynHandoff *handoff, void *data) {
+	if (handoff == NULL) {
+		return false;
+	}
+
+	DynFrame *toPush = dynstackFrameNew(data);
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toPush == NULL) {
+		return false;
+	}
+
+	if (handoff->batch == NULL) {
+		handoff->batchBottom = toPush;
+	}
+	toPush->next = handoff->batch;
+	handoff->batch = toPush;
+	(handoff->batchSize)++;
+	return true;
+}
+
+
+void dynstackHandoffPublish(DynHandoff *handoff) {
+	if (handoff == NULL || handoff->batch == NULL) {
+		return;
+	}
+
+	// Take back whatever the consumer hasn't collected yet and put it under the batch.
+	// Only the producer ever stores a non-NULL chain, so `shared` stays NULL until the
+	// store below and a plain release store is enough to publish the combined chain.
+	DynFrame *unclaimed = __atomic_exchange_n(&(handoff->shared), NULL, __ATOMIC_ACQUIRE);
+	handoff->batchBottom->next = unclaimed;
+	__atomic_store_n(&(handoff->shared), handoff->batch, __ATOMIC_RELEASE);
+
+	handoff->batch = NULL;
+	handoff->batchBottom = NULL;
+	handoff->batchSize = 0;
+}
+
+
+size_t dynstackHandoffTake(DynHandoff *handoff, DynStack *into) {
+	if (handoff == NULL || into == NULL) {
+		return 0;
+	}
+
+	DynFrame *top = __atomic_exchange_n(&(handoff->shared), NULL, __ATOMIC_ACQUIRE);
+	DynFrame *kept = handoff->kept;
+	handoff->kept = NULL;
+	if (top == NULL) {
+		top = kept;
+		kept = NULL;
+	}
+	if (top == NULL) {
+		return 0;
+	}
+
+	// The chain is private to the consumer now, so it can be walked without synchronization.
+	// Anything kept from an earlier take is older than what was published since, so it is
+	// linked in underneath.
+	size_t count = 1;
+	DynFrame *bottom = top;
+	while (bottom->next != NULL || kept != NULL) {
+		if (bottom->next == NULL) {
+			bottom->next = kept;
+			kept = NULL;
+		}
+		bottom = bottom->next;
+		count++;
+	}
+
+	// Only the producer ever stores into `shared`, so the chain waits here instead
+	if (!dynstackPushChain(into, top, bottom, count)) {
+		handoff->kept = top;
+		return 0;
+	}
+	return count;
+}
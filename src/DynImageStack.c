@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DynImageStack.h"
+
+
+static char *printRecord(void *data) {
+	char *toReturn = malloc(32);
+	if (toReturn != NULL) {
+		snprintf(toReturn, 32, "<%zu bytes>", ((DynImageRecord *)data)->length);
+	}
+	return toReturn;
+}
+
+
+DynImageStack *dynstackImageOpen(const char *filename) {
+	if (filename == NULL) {
+		return NULL;
+	}
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(DynFileHeader)) {
+		close(fd);
+		return NULL;
+	}
+
+	// The mapping keeps the file alive, so the descriptor isn't needed past this point
+	size_t mapSize = (size_t)info.st_size;
+	const char *map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	DynFileHeader header;
+	memcpy(&header, map, sizeof(header));
+	if (memcmp(header.magic, DYNSTACK_FILE_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != DYNSTACK_FILE_VERSION) {
+		munmap((void *)map, mapSize);
+		return NULL;
+	}
+
+	DynImageStack *toReturn = malloc(sizeof(DynImageStack));
+	DynStack *overlay = dynstackNew(free, printRecord);
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL || overlay == NULL) {
+		free(toReturn);
+		dynstackFree(overlay);
+		munmap((void *)map, mapSize);
+		return NULL;
+	}
+
+	// Records are stored top to bottom, so pops read straight through the file
+	posix_madvise((void *)map, mapSize, POSIX_MADV_SEQUENTIAL);
+
+	toReturn->map = map;
+	toReturn->mapSize = mapSize;
+	toReturn->cursor = sizeof(DynFileHeader);
+	toReturn->remaining = header.count;
+	toReturn->overlay = overlay;
+	toReturn->popped = NULL;
+
+	return toReturn;
+}
+
+
+void dynstackImageClose(DynImageStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	dynstackFree(stack->overlay);
+	free(stack->popped);
+	munmap((void *)stack->map, stack->mapSize);
+	free(stack);
+}
+
+
+bool dynstackImagePush(DynImageStack *stack, const void *record, size_t length) {
+	if (stack == NULL || (record == NULL && length > 0)) {
+		return false;
+	}
+
+	DynImageRecord *copy = malloc(sizeof(DynImageRecord) + length);
+	if (copy == NULL) {
+		return false;
+	}
+
+	copy->length = length;
+	memcpy(copy->bytes, record, length);
+
+	if (!dynstackPush(stack->overlay, copy)) {
+		free(copy);
+		return false;
+	}
+
+	free(stack->popped);
+	stack->popped = NULL;
+	return true;
+}
+
+
+const void *dynstackImagePeek(const DynImageStack *stack, size_t *length) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	if (!dynstackIsEmpty(stack->overlay)) {
+		DynImageRecord *top = dynstackPeek(stack->overlay);
+		if (length != NULL) {
+			*length = top->length;
+		}
+		return top->bytes;
+	}
+
+	// A truncated image ends the stack early rather than reading past the mapping
+	uint64_t recordLength;
+	if (stack->remaining == 0 || stack->mapSize - stack->cursor < sizeof(recordLength)) {
+		return NULL;
+	}
+
+	memcpy(&recordLength, stack->map + stack->cursor, sizeof(recordLength));
+	if (recordLength > stack->mapSize - stack->cursor - sizeof(recordLength)) {
+		return NULL;
+	}
+
+	if (length != NULL) {
+		*length = recordLength;
+	}
+	return stack->map + stack->cursor + sizeof(recordLength);
+}
+
+
+const void *dynstackImagePop(DynImageStack *stack, size_t *length) {
+	size_t recordLength;
+	const void *toReturn = dynstackImagePeek(stack, &recordLength);
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	free(stack->popped);
+	stack->popped = NULL;
+
+	if (!dynstackIsEmpty(stack->overlay)) {
+		stack->popped = dynstackPop(stack->overlay);
+	} else {
+		stack->cursor += sizeof(uint64_t) + recordLength;
+		(stack->remaining)--;
+	}
+
+	if (length != NULL) {
+		*length = recordLength;
+	}
+	return toReturn;
+}
+
+
+uint64_t dynstackImageGetSize(const DynImageStack *stack) {
+	if (stack == NULL) {
+		return 0;
+	}
+	return dynstackGetSize(stack->overlay) + stack->remaining;
+}
+
+
+bool dynstackImageIsEmpty(const DynImageStack *stack) {
+	return dynstackImageGetSize(stack) == 0;
+}
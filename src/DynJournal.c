@@ -0,0 +1,464 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DynJournal.h"
+
+
+#define OP_PUSH '+'
+#define OP_POP '-'
+
+
+/*
+ * Returns a malloc'd string naming the file `<path><suffix>`.
+ */
+static char *pathWithSuffix(const char *path, const char *suffix) {
+	char *toReturn = malloc(strlen(path) + strlen(suffix) + 1);
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	strcpy(toReturn, path);
+	strcat(toReturn, suffix);
+	return toReturn;
+}
+
+
+/*
+ * Returns a malloc'd string naming the snapshot `<path>.<generation>`.
+ */
+static char *snapshotPath(const char *path, uint64_t generation) {
+	char suffix[24];
+	snprintf(suffix, sizeof(suffix), ".%llu", (unsigned long long)generation);
+	return pathWithSuffix(path, suffix);
+}
+
+
+static bool writeAll(int fd, const void *data, size_t length) {
+	const char *cur = data;
+	while (length > 0) {
+		ssize_t written = write(fd, cur, length);
+		if (written < 0) {
+			return false;
+		}
+		cur += written;
+		length -= (size_t)written;
+	}
+	return true;
+}
+
+
+static bool syncFile(const char *filename) {
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	bool ok = (fsync(fd) == 0);
+	close(fd);
+	return ok;
+}
+
+
+/*
+ * Makes the directory entries in the directory containing `filename` durable.
+ */
+static bool syncDirectory(const char *filename) {
+	const char *slash = strrchr(filename, '/');
+	if (slash == NULL) {
+		return syncFile(".");
+	}
+
+	// The root directory is the only one whose name ends with the slash
+	size_t length = (slash == filename) ? 1 : (size_t)(slash - filename);
+	char *directory = malloc(length + 1);
+	if (directory == NULL) {
+		return false;
+	}
+	memcpy(directory, filename, length);
+	directory[length] = '\0';
+
+	bool ok = syncFile(directory);
+	free(directory);
+	return ok;
+}
+
+
+/*
+ * Creates the journal file `filename` containing only a header for `generation`.
+ */
+static bool writeEmptyJournal(const char *filename, uint64_t generation) {
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	DynJournalHeader header;
+	memcpy(header.magic, DYNJOURNAL_MAGIC, sizeof(header.magic));
+	header.version = DYNJOURNAL_VERSION;
+	header.generation = generation;
+
+	bool ok = writeAll(fd, &header, sizeof(header)) && fsync(fd) == 0;
+	close(fd);
+	return ok;
+}
+
+
+/*
+ * Writes the buffered operations to the journal, followed by an fdatasync if `sync` is set.
+ */
+static bool flushBuffer(DynJournal *journal, bool sync) {
+	if (!writeAll(journal->fd, journal->buffer, journal->used)) {
+		// Drop whatever part of the buffer made it, so that a retry doesn't write it twice
+		ftruncate(journal->fd, (off_t)journal->journalSize);
+		return false;
+	}
+
+	journal->journalSize += journal->used;
+	journal->used = 0;
+
+	if (sync) {
+		journal->pending = 0;
+		return fdatasync(journal->fd) == 0;
+	}
+	return true;
+}
+
+
+/*
+ * Appends `length` bytes to the buffer of pending operations, writing the buffer out
+ * first if they don't fit. Data too large for the buffer is written directly.
+ */
+static bool appendBytes(DynJournal *journal, const void *data, size_t length) {
+	if (journal->used + length > DYNJOURNAL_BUFFER_SIZE && !flushBuffer(journal, false)) {
+		return false;
+	}
+
+	if (length > DYNJOURNAL_BUFFER_SIZE) {
+		if (!writeAll(journal->fd, data, length)) {
+			ftruncate(journal->fd, (off_t)journal->journalSize);
+			return false;
+		}
+		journal->journalSize += length;
+		return true;
+	}
+
+	memcpy(journal->buffer + journal->used, data, length);
+	journal->used += length;
+	return true;
+}
+
+
+/*
+ * Removes a record that was only partly appended, given the journal size and buffer use
+ * from just before it, so that the next record starts where it did.
+ */
+static void dropRecord(DynJournal *journal, uint64_t startSize, size_t startUsed) {
+	uint64_t recordStart = startSize + startUsed;
+	if (journal->journalSize <= recordStart) {
+		// None of the record has reached the file yet
+		journal->used = startUsed;
+		return;
+	}
+
+	// The buffer was written out while the record was being appended
+	journal->used = 0;
+	journal->journalSize = recordStart;
+	if (ftruncate(journal->fd, (off_t)recordStart) != 0) {
+		journal->failed = true;
+	}
+}
+
+
+/*
+ * Counts one more recorded operation and commits the group if it is complete.
+ * A failure is remembered, to be reported by the next `dynstackJournalSync`.
+ */
+static void endOperation(DynJournal *journal) {
+	(journal->pending)++;
+
+	bool ok;
+	if (journal->syncEvery == DYNJOURNAL_SYNC_NEVER) {
+		ok = flushBuffer(journal, false);
+	} else if (journal->pending >= journal->syncEvery) {
+		ok = flushBuffer(journal, true);
+	} else {
+		return;
+	}
+
+	if (ok && journal->journalSize > DYNJOURNAL_COMPACT_SIZE) {
+		ok = dynstackJournalCompact(journal);
+	}
+	if (!ok) {
+		journal->failed = true;
+	}
+}
+
+
+/*
+ * Replays every complete operation in the journal `fp` onto `stack`, and returns the
+ * offset just past the last one. Anything after that offset is a torn write.
+ */
+static long replay(FILE *fp, DynStack *stack, void *(*deserializeFunc)(const void *, size_t)) {
+	long end = ftell(fp);
+	char *payload = NULL;
+	size_t capacity = 0;
+
+	int op;
+	while ((op = fgetc(fp)) != EOF) {
+		if (op == OP_POP) {
+			dynstackDeleteData(stack, dynstackPop(stack));
+		} else if (op == OP_PUSH) {
+			uint64_t length;
+			if (fread(&length, sizeof(length), 1, fp) != 1) {
+				break;
+			}
+
+			if (length > capacity) {
+				char *grown = realloc(payload, length);
+				if (grown == NULL) {
+					break;
+				}
+				payload = grown;
+				capacity = length;
+			}
+
+			if (fread(payload, 1, length, fp) != length) {
+				break;
+			}
+
+			void *data = deserializeFunc(payload, length);
+			if (!dynstackPush(stack, data)) {
+				dynstackDeleteData(stack, data);
+				break;
+			}
+		} else {
+			break;
+		}
+
+		end = ftell(fp);
+	}
+
+	free(payload);
+	return end;
+}
+
+
+DynJournal *dynstackJournalOpen(const char *path, void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*serializeFunc)(void *, size_t *), void *(*deserializeFunc)(const void *, size_t),
+		unsigned int syncEvery) {
+	if (path == NULL || serializeFunc == NULL || deserializeFunc == NULL) {
+		return NULL;
+	}
+
+	DynJournal *toReturn = malloc(sizeof(DynJournal));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	toReturn->path = pathWithSuffix(path, "");
+	toReturn->buffer = malloc(DYNJOURNAL_BUFFER_SIZE);
+	toReturn->stack = NULL;
+	toReturn->fd = -1;
+	toReturn->used = 0;
+	toReturn->pending = 0;
+	toReturn->failed = false;
+	toReturn->syncEvery = syncEvery;
+	toReturn->serializeData = serializeFunc;
+	if (toReturn->path == NULL || toReturn->buffer == NULL) {
+		dynstackJournalClose(toReturn);
+		return NULL;
+	}
+
+	// A missing journal is created empty, on top of no snapshot
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL && (errno != ENOENT || !writeEmptyJournal(path, 0))) {
+		dynstackJournalClose(toReturn);
+		return NULL;
+	} else if (fp == NULL) {
+		fp = fopen(path, "rb");
+	}
+
+	DynJournalHeader header;
+	if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1
+			|| memcmp(header.magic, DYNJOURNAL_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != DYNJOURNAL_VERSION) {
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		dynstackJournalClose(toReturn);
+		return NULL;
+	}
+	toReturn->generation = header.generation;
+
+	if (header.generation == 0) {
+		toReturn->stack = dynstackNew(deleteFunc, printFunc);
+	} else {
+		char *snapshot = snapshotPath(path, header.generation);
+		if (snapshot != NULL) {
+			toReturn->stack = dynstackLoad(snapshot, deleteFunc, printFunc, deserializeFunc);
+		}
+		free(snapshot);
+	}
+
+	if (toReturn->stack == NULL) {
+		fclose(fp);
+		dynstackJournalClose(toReturn);
+		return NULL;
+	}
+
+	long end = replay(fp, toReturn->stack, deserializeFunc);
+	fclose(fp);
+
+	// Drop any torn write at the end so that new operations follow the last complete one
+	toReturn->fd = open(path, O_WRONLY | O_APPEND);
+	if (toReturn->fd < 0 || end < 0 || ftruncate(toReturn->fd, (off_t)end) != 0) {
+		dynstackJournalClose(toReturn);
+		return NULL;
+	}
+	toReturn->journalSize = (uint64_t)end;
+
+	return toReturn;
+}
+
+
+void dynstackJournalClose(DynJournal *journal) {
+	if (journal == NULL) {
+		return;
+	}
+
+	if (journal->fd >= 0) {
+		dynstackJournalSync(journal);
+		close(journal->fd);
+	}
+
+	dynstackFree(journal->stack);
+	free(journal->buffer);
+	free(journal->path);
+	free(journal);
+}
+
+
+DynStack *dynstackJournalGetStack(const DynJournal *journal) {
+	if (journal == NULL) {
+		return NULL;
+	}
+	return journal->stack;
+}
+
+
+bool dynstackJournalPush(DynJournal *journal, void *data) {
+	if (journal == NULL) {
+		return false;
+	}
+
+	size_t length = 0;
+	void *record = journal->serializeData(data, &length);
+	if (record == NULL) {
+		return false;
+	}
+
+	uint64_t startSize = journal->journalSize;
+	size_t startUsed = journal->used;
+
+	char op = OP_PUSH;
+	uint64_t prefix = length;
+	bool ok = appendBytes(journal, &op, sizeof(op))
+		&& appendBytes(journal, &prefix, sizeof(prefix))
+		&& appendBytes(journal, record, length);
+	free(record);
+
+	// The stack only changes once the operation is in the journal,
+	// otherwise a compaction triggered by it would miss the element
+	if (!ok || !dynstackPush(journal->stack, data)) {
+		dropRecord(journal, startSize, startUsed);
+		return false;
+	}
+
+	// The element belongs to the stack from now on, even if committing it fails
+	endOperation(journal);
+	return true;
+}
+
+
+void *dynstackJournalPop(DynJournal *journal) {
+	if (journal == NULL || dynstackIsEmpty(journal->stack)) {
+		return NULL;
+	}
+
+	char op = OP_POP;
+	if (!appendBytes(journal, &op, sizeof(op))) {
+		return NULL;
+	}
+
+	void *toReturn = dynstackPop(journal->stack);
+	endOperation(journal);
+	return toReturn;
+}
+
+
+bool dynstackJournalSync(DynJournal *journal) {
+	if (journal == NULL) {
+		return false;
+	}
+
+	bool failed = journal->failed;
+	journal->failed = false;
+	return flushBuffer(journal, true) && !failed;
+}
+
+
+bool dynstackJournalCompact(DynJournal *journal) {
+	if (journal == NULL || !dynstackJournalSync(journal)) {
+		return false;
+	}
+
+	uint64_t generation = journal->generation + 1;
+	char *snapshot = snapshotPath(journal->path, generation);
+	char *tempJournal = pathWithSuffix(journal->path, ".tmp");
+
+	// The snapshot must be durable before the journal that refers to it replaces the old one.
+	// The new journal is opened before the rename, so nothing can fail once it is in place
+	int fd = -1;
+	bool ok = snapshot != NULL && tempJournal != NULL
+		&& dynstackSave(journal->stack, snapshot, journal->serializeData)
+		&& syncFile(snapshot)
+		&& writeEmptyJournal(tempJournal, generation)
+		&& (fd = open(tempJournal, O_WRONLY | O_APPEND)) >= 0
+		&& rename(tempJournal, journal->path) == 0;
+
+	if (ok) {
+		close(journal->fd);
+		journal->fd = fd;
+		journal->journalSize = sizeof(DynJournalHeader);
+
+		// Until the rename itself is durable, a crash can bring back the old journal,
+		// so the snapshot it refers to has to stay until then
+		ok = syncDirectory(journal->path);
+		char *oldSnapshot = snapshotPath(journal->path, journal->generation);
+		if (ok && journal->generation > 0 && oldSnapshot != NULL) {
+			unlink(oldSnapshot);
+		}
+		free(oldSnapshot);
+		journal->generation = generation;
+	} else {
+		if (fd >= 0) {
+			close(fd);
+		}
+		if (tempJournal != NULL) {
+			unlink(tempJournal);
+		}
+		if (snapshot != NULL) {
+			unlink(snapshot);
+		}
+	}
+
+	free(snapshot);
+	free(tempJournal);
+	return ok;
+}
@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "DynMPStack.h"
+
+
+DynMPStack *dynstackMPNew(void) {
+	void *aligned = NULL;
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (posix_memalign(&aligned, DYNSTACK_CACHE_LINE, sizeof(DynMPStack)) != 0) {
+		return NULL;
+	}
+	DynMPStack *toReturn = aligned;
+
+	toReturn->top = NULL;
+	toReturn->kept = NULL;
+
+	return toReturn;
+}
+
+
+void dynstackMPFree(DynMPStack *stack, void (*deleteFunc)(void *)) {
+	if (stack == NULL) {
+		return;
+	}
+
+	// Taking everything also collects the frames kept aside for the consumer
+	DynFrame *cur = dynstackMPTakeAll(stack, false);
+	while (cur != NULL) {
+		DynFrame *next = cur->next;
+		if (deleteFunc != NULL) {
+			deleteFunc(cur->data);
+		}
+		free(cur);
+		cur = next;
+	}
+
+	free(stack);
+}
+
+
+bool dynstackMPPush(DynMPStack *stack, void *data) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	DynFrame *toPush = dynstackFrameNew(data);
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toPush == NULL) {
+		return false;
+	}
+
+	// A failed compare-and-swap reloads the current top into `toPush->next`
+	toPush->next = __atomic_load_n(&(stack->top), __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&(stack->top), &(toPush->next), toPush,
+			true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		// Another thread pushed first; try again on top of its frame
+	}
+
+	return true;
+}
+
+
+DynFrame *dynstackMPTakeAll(DynMPStack *stack, bool fifo) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	DynFrame *cur = __atomic_exchange_n(&(stack->top), NULL, __ATOMIC_ACQUIRE);
+
+	// Anything kept from an earlier take is older than what was pushed since, so it goes
+	// underneath
+	if (stack->kept != NULL) {
+		if (cur == NULL) {
+			cur = stack->kept;
+		} else {
+			DynFrame *bottom = cur;
+			while (bottom->next != NULL) {
+				bottom = bottom->next;
+			}
+			bottom->next = stack->kept;
+		}
+		stack->kept = NULL;
+	}
+
+	if (!fifo) {
+		return cur;
+	}
+
+	// The chain is private to the caller now, so it can be reversed in place
+	DynFrame *reversed = NULL;
+	while (cur != NULL) {
+		DynFrame *next = cur->next;
+		cur->next = reversed;
+		reversed = cur;
+		cur = next;
+	}
+
+	return reversed;
+}
+
+
+size_t dynstackMPTakeAllInto(DynMPStack *stack, DynStack *into) {
+	if (stack == NULL || into == NULL) {
+		return 0;
+	}
+
+	DynFrame *top = dynstackMPTakeAll(stack, false);
+	if (top == NULL) {
+		return 0;
+	}
+
+	size_t count = 1;
+	DynFrame *bottom = top;
+	while (bottom->next != NULL) {
+		bottom = bottom->next;
+		count++;
+	}
+
+	// Only producers ever store into `top`, so the chain waits here instead
+	if (!dynstackPushChain(into, top, bottom, count)) {
+		stack->kept = top;
+		return 0;
+	}
+	return count;
+}
+
+
+bool dynstackMPIsEmpty(const DynMPStack *stack) {
+	return stack == NULL
+		|| (__atomic_load_n(&(stack->top), __ATOMIC_RELAXED) == NULL && stack->kept == NULL);
+}
@@ -0,0 +1,195 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "DynOperandStack.h"
+#include "DynVMem.h"
+
+
+// Every operand stack the fault handler knows about. Slots are claimed and released with
+// atomic operations so that the handler can read them at any moment.
+static DynOperandStack *registered[DYNOPERAND_MAX_LAZY];
+
+static void (*overflowHook)(DynOperandStack *) = NULL;
+static struct sigaction previousAction;
+static bool handlerInstalled = false;
+
+
+static bool registerStack(DynOperandStack *stack) {
+	for (size_t i = 0; i < DYNOPERAND_MAX_LAZY; i++) {
+		DynOperandStack *expected = NULL;
+		if (__atomic_compare_exchange_n(&registered[i], &expected, stack,
+				false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void unregisterStack(DynOperandStack *stack) {
+	for (size_t i = 0; i < DYNOPERAND_MAX_LAZY; i++) {
+		if (__atomic_load_n(&registered[i], __ATOMIC_ACQUIRE) == stack) {
+			__atomic_store_n(&registered[i], NULL, __ATOMIC_RELEASE);
+			return;
+		}
+	}
+}
+
+
+/*
+ * Handles a fault inside an operand stack's reservation: a fault above the committed slots
+ * commits the next chunk and returns, so the faulting push is simply retried. A fault in
+ * either guard page is an overflow (or underflow).
+ *
+ * mprotect isn't on POSIX's list of async-signal-safe functions, but it is a plain system
+ * call on every platform with this kind of fault handling, which is what makes it usable here.
+ */
+static void handleFault(int signal, siginfo_t *info, void *context) {
+	char *address = info->si_addr;
+
+	for (size_t i = 0; i < DYNOPERAND_MAX_LAZY; i++) {
+		DynOperandStack *stack = __atomic_load_n(&registered[i], __ATOMIC_ACQUIRE);
+		char *start = (stack == NULL) ? NULL : stack->mapping;
+		if (stack == NULL || address < start || address >= start + stack->mappingSize) {
+			continue;
+		}
+
+		char *limit = (char *)(stack->base + stack->capacity);
+		if (address >= stack->committed && address < limit) {
+			size_t size = DYNOPERAND_COMMIT_SIZE;
+			if (size > (size_t)(limit - stack->committed)) {
+				size = (size_t)(limit - stack->committed);
+			}
+
+			if (dynstackVMemCommit(stack->committed, size)) {
+				stack->committed += size;
+				return;
+			}
+		}
+
+		if (overflowHook != NULL) {
+			overflowHook(stack);
+		}
+
+		static const char message[] = "DynOperandStack: stack overflow\n";
+		write(STDERR_FILENO, message, sizeof(message) - 1);
+		abort();
+	}
+
+	// Not an operand stack; let whoever was handling SIGSEGV before deal with it
+	if (previousAction.sa_flags & SA_SIGINFO) {
+		previousAction.sa_sigaction(signal, info, context);
+	} else if (previousAction.sa_handler != SIG_IGN && previousAction.sa_handler != SIG_DFL) {
+		previousAction.sa_handler(signal);
+	} else {
+		// Returning re-executes the faulting instruction, which now gets the default action
+		sigaction(SIGSEGV, &previousAction, NULL);
+	}
+}
+
+
+/*
+ * Reserves the memory of a new operand stack, committing all of it unless it is `lazy`.
+ */
+static DynOperandStack *newStack(size_t capacity, bool lazy) {
+	if (capacity == 0 || capacity > SIZE_MAX / sizeof(DynValue)) {
+		return NULL;
+	}
+
+	DynOperandStack *toReturn = malloc(sizeof(DynOperandStack));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	// [guard page][slots ...][guard page]: the last slot ends exactly where the upper guard
+	// page starts, so the first push past the capacity is the one that faults
+	size_t pageSize = dynstackPageSize();
+	size_t slotBytes = dynstackPageRound(capacity * sizeof(DynValue));
+	toReturn->mappingSize = slotBytes + 2 * pageSize;
+	toReturn->mapping = dynstackVMemReserve(toReturn->mappingSize);
+
+	if (toReturn->mapping == NULL) {
+		free(toReturn);
+		return NULL;
+	}
+
+	size_t commitBytes = slotBytes;
+	if (lazy && commitBytes > DYNOPERAND_COMMIT_SIZE) {
+		commitBytes = DYNOPERAND_COMMIT_SIZE;
+	}
+
+	char *slots = (char *)toReturn->mapping + pageSize;
+	if (!dynstackVMemCommit(slots, commitBytes)) {
+		dynstackVMemRelease(toReturn->mapping, toReturn->mappingSize);
+		free(toReturn);
+		return NULL;
+	}
+
+	toReturn->base = (DynValue *)slots;
+	toReturn->sp = toReturn->base;
+	toReturn->capacity = slotBytes / sizeof(DynValue);
+	toReturn->committed = slots + commitBytes;
+
+	return toReturn;
+}
+
+
+DynOperandStack *dynstackOperandNew(size_t capacity) {
+	DynOperandStack *toReturn = newStack(capacity, false);
+
+	// Registering is only needed to report overflows, so running out of slots is harmless
+	if (toReturn != NULL && handlerInstalled) {
+		registerStack(toReturn);
+	}
+	return toReturn;
+}
+
+
+DynOperandStack *dynstackOperandReserve(size_t capacity) {
+	if (!handlerInstalled) {
+		return NULL;
+	}
+
+	DynOperandStack *toReturn = newStack(capacity, true);
+	if (toReturn != NULL && !registerStack(toReturn)) {
+		dynstackOperandFree(toReturn);
+		return NULL;
+	}
+	return toReturn;
+}
+
+
+bool dynstackOperandInstallFaultHandler(void (*overflowFunc)(DynOperandStack *)) {
+	overflowHook = overflowFunc;
+	if (handlerInstalled) {
+		return true;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = handleFault;
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(SIGSEGV, &action, &previousAction) != 0) {
+		return false;
+	}
+
+	handlerInstalled = true;
+	return true;
+}
+
+
+void dynstackOperandFree(DynOperandStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	unregisterStack(stack);
+	dynstackVMemRelease(stack->mapping, stack->mappingSize);
+	free(stack);
+}
@@ -0,0 +1,122 @@
+#include "DynPriorityStack.h"
+
+
+/*
+ * Returns the highest level whose bit is set in `nonEmpty`, which must not be 0.
+ */
+static unsigned int highestLevel(uint64_t nonEmpty) {
+	return (DYNPRIORITY_MAX_LEVELS - 1) - (unsigned int)__builtin_clzll(nonEmpty);
+}
+
+
+DynPriorityStack *dynstackPriorityNew(unsigned int levelCount, void (*deleteFunc)(void *), char *(*printFunc)(void *)) {
+	if (levelCount == 0 || levelCount > DYNPRIORITY_MAX_LEVELS) {
+		return NULL;
+	}
+
+	DynPriorityStack *toReturn = malloc(sizeof(DynPriorityStack));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	toReturn->levelCount = levelCount;
+	toReturn->nonEmpty = 0;
+	toReturn->size = 0;
+	toReturn->pool = dynstackPoolNew();
+	memset(toReturn->levels, 0, sizeof(toReturn->levels));
+
+	if (toReturn->pool == NULL) {
+		dynstackPriorityFree(toReturn);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < levelCount; i++) {
+		toReturn->levels[i] = dynstackNew(deleteFunc, printFunc);
+		if (toReturn->levels[i] == NULL) {
+			dynstackPriorityFree(toReturn);
+			return NULL;
+		}
+		dynstackSetPool(toReturn->levels[i], toReturn->pool);
+	}
+
+	return toReturn;
+}
+
+
+void dynstackPriorityFree(DynPriorityStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	// The levels give their frames back to the pool, so it has to go last
+	for (unsigned int i = 0; i < stack->levelCount; i++) {
+		dynstackFree(stack->levels[i]);
+	}
+
+	dynstackPoolFree(stack->pool);
+	free(stack);
+}
+
+
+bool dynstackPriorityPush(DynPriorityStack *stack, unsigned int level, void *data) {
+	if (stack == NULL || level >= stack->levelCount) {
+		return false;
+	}
+
+	if (!dynstackPush(stack->levels[level], data)) {
+		return false;
+	}
+
+	stack->nonEmpty |= (uint64_t)1 << level;
+	(stack->size)++;
+	return true;
+}
+
+
+void *dynstackPriorityPeek(const DynPriorityStack *stack, unsigned int *level) {
+	if (stack == NULL || stack->nonEmpty == 0) {
+		return NULL;
+	}
+
+	unsigned int highest = highestLevel(stack->nonEmpty);
+	if (level != NULL) {
+		*level = highest;
+	}
+	return dynstackPeek(stack->levels[highest]);
+}
+
+
+void *dynstackPriorityPop(DynPriorityStack *stack, unsigned int *level) {
+	if (stack == NULL || stack->nonEmpty == 0) {
+		return NULL;
+	}
+
+	unsigned int highest = highestLevel(stack->nonEmpty);
+	DynStack *from = stack->levels[highest];
+	void *toReturn = dynstackPop(from);
+
+	if (dynstackIsEmpty(from)) {
+		stack->nonEmpty &= ~((uint64_t)1 << highest);
+	}
+	(stack->size)--;
+
+	if (level != NULL) {
+		*level = highest;
+	}
+	return toReturn;
+}
+
+
+size_t dynstackPriorityGetSize(const DynPriorityStack *stack) {
+	if (stack == NULL) {
+		return 0;
+	}
+	return stack->size;
+}
+
+
+bool dynstackPriorityIsEmpty(const DynPriorityStack *stack) {
+	return dynstackPriorityGetSize(stack) == 0;
+}
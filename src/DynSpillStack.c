@@ -0,0 +1,279 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "DynSpillStack.h"
+
+
+/*
+ * Moves the bottom `chunkSize` elements held in memory to the end of the file.
+ */
+static bool spillChunk(DynSpillStack *stack) {
+	DynSpillChunk *chunk = malloc(sizeof(DynSpillChunk));
+	if (chunk == NULL || fseeko(stack->file, 0, SEEK_END) != 0) {
+		free(chunk);
+		return false;
+	}
+
+	chunk->offset = ftello(stack->file);
+	chunk->bytes = 0;
+	chunk->count = 0;
+	chunk->prefetched = false;
+
+	// The lowest boundary is the last frame that stays in memory
+	DynStack *hot = stack->hot;
+	if (stack->boundaryCount == 0) {
+		free(chunk);
+		return false;
+	}
+	DynFrame *last = stack->boundaries[stack->boundaryFirst];
+
+	// Every element below it is written out, top to bottom
+	for (DynFrame *cur = last->next; cur != NULL; cur = cur->next) {
+		size_t length = 0;
+		void *record = stack->serializeData(cur->data, &length);
+		uint64_t prefix = length;
+
+		if (record == NULL
+				|| fwrite(&prefix, sizeof(prefix), 1, stack->file) != 1
+				|| fwrite(record, 1, length, stack->file) != length) {
+			// Leave the stack in memory untouched and throw away what was written
+			free(record);
+			fflush(stack->file);
+			ftruncate(fileno(stack->file), (off_t)chunk->offset);
+			free(chunk);
+			return false;
+		}
+
+		free(record);
+		chunk->bytes += sizeof(prefix) + length;
+		(chunk->count)++;
+	}
+
+	if (fflush(stack->file) != 0) {
+		ftruncate(fileno(stack->file), (off_t)chunk->offset);
+		free(chunk);
+		return false;
+	}
+
+	// Only now that the chunk is safely in the file can its elements be deleted. Every
+	// other group moves down by a whole chunk, so the remaining boundaries stay in place.
+	DynFrame *spilledTop = last->next;
+	last->next = NULL;
+	hot->size -= chunk->count;
+	for (DynFrame *cur = spilledTop; cur != NULL; cur = cur->next) {
+		dynstackDeleteData(hot, cur->data);
+	}
+	dynstackReleaseFrames(hot, spilledTop);
+
+	stack->boundaryFirst = (stack->boundaryFirst + 1) % stack->boundaryCapacity;
+	(stack->boundaryCount)--;
+	stack->spilled += chunk->count;
+	chunk->next = stack->chunks;
+	stack->chunks = chunk;
+	return true;
+}
+
+
+/*
+ * Reads the most recently spilled chunk back into the (empty) in-memory stack
+ * and removes it from the end of the file.
+ */
+static bool loadChunk(DynSpillStack *stack) {
+	DynSpillChunk *chunk = stack->chunks;
+	char *records = malloc(chunk->bytes > 0 ? chunk->bytes : 1);
+	if (records == NULL
+			|| fseeko(stack->file, (off_t)chunk->offset, SEEK_SET) != 0
+			|| fread(records, 1, chunk->bytes, stack->file) != chunk->bytes) {
+		free(records);
+		return false;
+	}
+
+	// Records are stored top to bottom, so each new frame is linked below the previous one
+	DynStack *hot = stack->hot;
+	DynFrame **link = &(hot->top);
+	size_t offset = 0;
+	for (size_t i = 0; i < chunk->count; i++) {
+		uint64_t length;
+		memcpy(&length, records + offset, sizeof(length));
+		offset += sizeof(length);
+
+		void *data = stack->deserializeData(records + offset, length);
+		DynFrame *frame = dynstackFrameNew(data);
+		if (frame == NULL) {
+			// The chunk is still intact in the file, so start over on the next attempt
+			dynstackDeleteData(hot, data);
+			free(records);
+			dynstackClear(hot);
+			return false;
+		}
+		offset += length;
+
+		*link = frame;
+		link = &(frame->next);
+		(hot->size)++;
+	}
+	free(records);
+
+	ftruncate(fileno(stack->file), (off_t)chunk->offset);
+	stack->spilled -= chunk->count;
+	stack->chunks = chunk->next;
+	free(chunk);
+	return true;
+}
+
+
+/*
+ * Asks the OS to start reading the next chunk ahead once the stack in memory is running
+ * low, so that `loadChunk` finds it in the page cache instead of waiting on the disk.
+ */
+static void prefetchChunk(DynSpillStack *stack) {
+	DynSpillChunk *chunk = stack->chunks;
+	if (chunk == NULL || chunk->prefetched || stack->hot->size > stack->chunkSize / 4) {
+		return;
+	}
+
+	posix_fadvise(fileno(stack->file), (off_t)chunk->offset, (off_t)chunk->bytes, POSIX_FADV_WILLNEED);
+	chunk->prefetched = true;
+}
+
+
+DynSpillStack *dynstackSpillNew(void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*serializeFunc)(void *, size_t *), void *(*deserializeFunc)(const void *, size_t),
+		size_t memoryBudget, size_t chunkSize) {
+	if (serializeFunc == NULL || deserializeFunc == NULL || chunkSize == 0 || chunkSize >= memoryBudget) {
+		return NULL;
+	}
+
+	DynSpillStack *toReturn = malloc(sizeof(DynSpillStack));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	// At most `memoryBudget` elements are in memory, so there are fewer boundaries than that
+	// divided by `chunkSize`
+	toReturn->boundaryCapacity = memoryBudget / chunkSize;
+	toReturn->boundaryFirst = 0;
+	toReturn->boundaryCount = 0;
+	toReturn->boundaries = malloc(toReturn->boundaryCapacity * sizeof(DynFrame *));
+	toReturn->hot = dynstackNew(deleteFunc, printFunc);
+	toReturn->file = tmpfile();
+	if (toReturn->boundaries == NULL || toReturn->hot == NULL || toReturn->file == NULL) {
+		free(toReturn->boundaries);
+		dynstackFree(toReturn->hot);
+		if (toReturn->file != NULL) {
+			fclose(toReturn->file);
+		}
+		free(toReturn);
+		return NULL;
+	}
+
+	toReturn->chunks = NULL;
+	toReturn->spilled = 0;
+	toReturn->memoryBudget = memoryBudget;
+	toReturn->chunkSize = chunkSize;
+	toReturn->serializeData = serializeFunc;
+	toReturn->deserializeData = deserializeFunc;
+
+	return toReturn;
+}
+
+
+void dynstackSpillFree(DynSpillStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	// Spilled elements still have to be recreated to be deleted, one chunk at a time
+	// into the empty in-memory stack
+	dynstackClear(stack->hot);
+	while (stack->chunks != NULL && loadChunk(stack)) {
+		dynstackClear(stack->hot);
+	}
+
+	while (stack->chunks != NULL) {
+		DynSpillChunk *next = stack->chunks->next;
+		free(stack->chunks);
+		stack->chunks = next;
+	}
+
+	dynstackFree(stack->hot);
+	fclose(stack->file);
+	free(stack->boundaries);
+	free(stack);
+}
+
+
+bool dynstackSpillPush(DynSpillStack *stack, void *data) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	if (stack->hot->size >= stack->memoryBudget && !spillChunk(stack)) {
+		return false;
+	}
+
+	if (!dynstackPush(stack->hot, data)) {
+		return false;
+	}
+
+	// The new frame is right above a full group
+	size_t size = stack->hot->size;
+	if (size > 1 && (size - 1) % stack->chunkSize == 0) {
+		size_t index = (stack->boundaryFirst + stack->boundaryCount) % stack->boundaryCapacity;
+		stack->boundaries[index] = stack->hot->top;
+		(stack->boundaryCount)++;
+	}
+	return true;
+}
+
+
+void *dynstackSpillPeek(DynSpillStack *stack) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	if (dynstackIsEmpty(stack->hot) && stack->chunks != NULL && !loadChunk(stack)) {
+		return NULL;
+	}
+
+	return dynstackPeek(stack->hot);
+}
+
+
+void *dynstackSpillPop(DynSpillStack *stack) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	if (dynstackSpillPeek(stack) == NULL && dynstackIsEmpty(stack->hot)) {
+		return NULL;
+	}
+
+	// The frame going away may be the highest boundary
+	size_t size = stack->hot->size;
+	if (size > 1 && (size - 1) % stack->chunkSize == 0) {
+		(stack->boundaryCount)--;
+	}
+
+	void *toReturn = dynstackPop(stack->hot);
+	prefetchChunk(stack);
+	return toReturn;
+}
+
+
+unsigned long long dynstackSpillGetSize(const DynSpillStack *stack) {
+	if (stack == NULL) {
+		return 0;
+	}
+	return dynstackGetSize(stack->hot) + stack->spilled;
+}
+
+
+bool dynstackSpillIsEmpty(const DynSpillStack *stack) {
+	return dynstackSpillGetSize(stack) == 0;
+}
@@ -1,23 +1,372 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sched.h>
+#include <unistd.h>
+
 #include "DynStack.h"
+#include "DynVMem.h"
 
 
-DynStack *dynstackNew(void (*deleteFunc)(void *), char *(*printFunc)(void *)) {
-	if (deleteFunc == NULL || printFunc == NULL) {
+// Number of times a contended lock is polled before the thread yields its time slice
+#define SPIN_LIMIT 128
+
+
+/*
+ * Acquires the lock embedded in a DYNSTACK_THREADSAFE stack. Stacks without the flag
+ * aren't locked at all, which costs them a single well-predicted branch.
+ *
+ * An uncontended acquire is one atomic exchange. A contended one spins on plain loads
+ * (which stay in the local cache) for a while before yielding, since the critical
+ * sections of this library are only a few instructions long.
+ */
+static void lockStack(const DynStack *stack) {
+	if (!(stack->flags & DYNSTACK_THREADSAFE)) {
+		return;
+	}
+
+	int *lock = (int *)&(stack->lock);
+	while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0) {
+		unsigned int spins = 0;
+		while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0) {
+			if (++spins >= SPIN_LIMIT) {
+				sched_yield();
+				spins = 0;
+			}
+		}
+	}
+}
+
+
+static void unlockStack(const DynStack *stack) {
+	if (stack->flags & DYNSTACK_THREADSAFE) {
+		__atomic_store_n((int *)&(stack->lock), 0, __ATOMIC_RELEASE);
+	}
+}
+
+
+void dynstackLock(const DynStack *stack) {
+	if (stack != NULL) {
+		lockStack(stack);
+	}
+}
+
+
+void dynstackUnlock(const DynStack *stack) {
+	if (stack != NULL) {
+		unlockStack(stack);
+	}
+}
+
+
+/*
+ * Returns true if the stack is responsible for deleting its elements.
+ */
+static bool ownsData(const DynStack *stack) {
+	return !(stack->flags & (DYNSTACK_BORROWED | DYNSTACK_TRIVIAL));
+}
+
+
+/*
+ * Returns the string printed in place of `count` elements by a stack without `printData`,
+ * which is empty if there are no elements at all.
+ */
+static char *countToString(size_t count) {
+	char *toReturn = malloc(32);
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	if (count == 0) {
+		toReturn[0] = '\0';
+	} else {
+		snprintf(toReturn, 32, "<%zu element%s>", count, (count == 1) ? "" : "s");
+	}
+	return toReturn;
+}
+
+
+/*
+ * Tells whether `frame` is one of the frames stored inside the stack's struct.
+ */
+static bool isInline(const DynStack *stack, const DynFrame *frame) {
+	return frame >= stack->inlineFrames && frame < stack->inlineFrames + DYNSTACK_INLINE_FRAMES;
+}
+
+
+/*
+ * Takes one of the stack's inline frames if any is free, otherwise a frame from the stack's
+ * frame pool. Returns NULL if there is neither. The stack must be locked by the caller.
+ */
+static DynFrame *takeFrame(DynStack *stack) {
+	DynFrame *toReturn = stack->inlineFree;
+	if (toReturn != NULL) {
+		stack->inlineFree = toReturn->next;
+		(stack->inlineUsed)++;
+		return toReturn;
+	}
+
+	DynFramePool *pool = stack->pool;
+	if (pool == NULL || pool->frames == NULL) {
+		return NULL;
+	}
+
+	toReturn = pool->frames;
+	pool->frames = toReturn->next;
+	(pool->count)--;
+	return toReturn;
+}
+
+
+/*
+ * Gives a frame that is no longer used back to the stack's inline frames or frame pool.
+ * Returns the frame if the stack has no pool, in which case the caller must free it once
+ * the stack is unlocked, or NULL otherwise. The stack must be locked by the caller.
+ */
+static DynFrame *putFrame(DynStack *stack, DynFrame *frame) {
+	if (isInline(stack, frame)) {
+		frame->next = stack->inlineFree;
+		stack->inlineFree = frame;
+		(stack->inlineUsed)--;
 		return NULL;
 	}
 
-	DynStack *toReturn = malloc(sizeof(DynStack));
+	DynFramePool *pool = stack->pool;
+	if (pool == NULL) {
+		return frame;
+	}
+
+	frame->next = pool->frames;
+	pool->frames = frame;
+	(pool->count)++;
+	return NULL;
+}
+
+
+/*
+ * Returns a frame holding `data`: one of the stack's inline frames if any is free, otherwise
+ * one from the stack's frame pool, otherwise (if `allocate` is set) a newly allocated one.
+ * The stack must not be locked by the caller.
+ */
+static DynFrame *acquireFrame(DynStack *stack, void *data, bool allocate) {
+	lockStack(stack);
+	DynFrame *toReturn = takeFrame(stack);
+	unlockStack(stack);
+
+	if (toReturn == NULL) {
+		// A real-time stack never allocates, so it runs out of frames instead
+		if (!allocate || (stack->flags & DYNSTACK_REALTIME)) {
+			return NULL;
+		}
+
+		toReturn = dynstackFrameNew(data);
+		if (toReturn == NULL) {
+			return NULL;
+		}
+
+		lockStack(stack);
+		if (stack->pool != NULL) {
+			(stack->pool->allocations)++;
+		}
+		unlockStack(stack);
+	}
+
+	toReturn->data = data;
+	toReturn->next = NULL;
+	return toReturn;
+}
+
+
+/*
+ * Gives a frame that is no longer used back to the stack's inline frames or frame pool,
+ * or frees it. The stack must not be locked by the caller.
+ */
+static void releaseFrame(DynStack *stack, DynFrame *frame) {
+	lockStack(stack);
+	DynFrame *toFree = putFrame(stack, frame);
+	unlockStack(stack);
+
+	free(toFree);
+}
+
+
+/*
+ * Gives a detached chain of `count` frames, from `top` down to `bottom`, back to the stack's
+ * frame pool in one splice, or frees every frame if the stack doesn't use a pool.
+ * Inline frames are picked out of the chain first, and go back to the stack.
+ */
+static void releaseChain(DynStack *stack, DynFrame *top, DynFrame *bottom, size_t count) {
+	lockStack(stack);
+	size_t inlineUsed = stack->inlineUsed;
+	unlockStack(stack);
+
+	if (inlineUsed > 0) {
+		// The walk can stop as soon as every inline frame in use has been found
+		DynFrame *inlineTop = NULL;
+		DynFrame *inlineBottom = NULL;
+		size_t inlineCount = 0;
+		DynFrame *kept = NULL;
+		DynFrame **link = &top;
+		while (*link != NULL && inlineCount < inlineUsed) {
+			DynFrame *frame = *link;
+			if (isInline(stack, frame)) {
+				*link = frame->next;
+				frame->next = inlineTop;
+				inlineTop = frame;
+				if (inlineBottom == NULL) {
+					inlineBottom = frame;
+				}
+				inlineCount++;
+			} else {
+				kept = frame;
+				link = &(frame->next);
+			}
+		}
+
+		// If the walk reached the end, the original bottom may have been picked out
+		if (*link == NULL) {
+			bottom = kept;
+		}
+		count -= inlineCount;
+
+		if (inlineTop != NULL) {
+			lockStack(stack);
+			inlineBottom->next = stack->inlineFree;
+			stack->inlineFree = inlineTop;
+			stack->inlineUsed -= inlineCount;
+			unlockStack(stack);
+		}
+
+		if (top == NULL) {
+			return;
+		}
+	}
+
+	lockStack(stack);
+	DynFramePool *pool = stack->pool;
+	if (pool != NULL) {
+		bottom->next = pool->frames;
+		pool->frames = top;
+		pool->count += count;
+		unlockStack(stack);
+		return;
+	}
+	unlockStack(stack);
+
+	while (top != NULL) {
+		DynFrame *next = top->next;
+		free(top);
+		top = next;
+	}
+}
+
+
+/*
+ * Deletes the data of every frame in the detached chain starting at `cur`, then gives all
+ * of the frames back at once: a pool gets the whole chain spliced onto it in one step.
+ */
+static void deleteChain(DynStack *stack, DynFrame *cur, size_t count) {
+	if (cur == NULL) {
+		return;
+	}
+
+	// Elements the stack doesn't own are left alone, so only the frames have to go
+	if (!ownsData(stack)) {
+		dynstackReleaseFrames(stack, cur);
+		return;
+	}
+
+	DynFrame *bottom = cur;
+	for (DynFrame *frame = cur; frame != NULL; frame = frame->next) {
+		stack->deleteData(frame->data);
+		bottom = frame;
+	}
+
+	releaseChain(stack, cur, bottom, count);
+}
+
+
+unsigned int dynstackAbiVersion(void) {
+	return DYNSTACK_ABI_VERSION;
+}
+
+
+DynStack *dynstackNew(void (*deleteFunc)(void *), char *(*printFunc)(void *)) {
+	return dynstackNewFlags(deleteFunc, printFunc, 0);
+}
+
+
+DynStack *dynstackNewFlags(void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags) {
+	DynStack *toReturn;
+	if (flags & DYNSTACK_ALIGNED) {
+		// Rounding the size up keeps the next allocation off the stack's last cache line
+		size_t size = (sizeof(DynStack) + DYNSTACK_CACHE_LINE - 1) / DYNSTACK_CACHE_LINE * DYNSTACK_CACHE_LINE;
+		void *aligned = NULL;
+		toReturn = (posix_memalign(&aligned, DYNSTACK_CACHE_LINE, size) == 0) ? aligned : NULL;
+	} else {
+		toReturn = malloc(sizeof(DynStack));
+	}
 
 	// Can't assume malloc works every time, no matter how unlikely
 	if (toReturn == NULL) {
 		return NULL;
 	}
 
-	toReturn->top = NULL;
-	toReturn->size = 0;
-	toReturn->deleteData = deleteFunc;
-	toReturn->printData = printFunc;
+	dynstackInit(toReturn, deleteFunc, printFunc, flags);
+	return toReturn;
+}
+
+
+bool dynstackInit(DynStack *stack, void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	// Only `dynstackReserve` and `dynstackNewRealtime` may give a stack a pool of its own,
+	// and a real-time stack without its locked pool would fail every push past its inline frames
+	flags &= ~DYNSTACK_REALTIME;
+
+	// Without a way to delete its elements, the stack can't own them
+	if (deleteFunc == NULL) {
+		flags |= DYNSTACK_BORROWED;
+	}
+
+	stack->top = NULL;
+	stack->size = 0;
+	stack->deleteData = deleteFunc;
+	stack->printData = printFunc;
+	stack->flags = flags;
+	stack->lock = 0;
+	stack->waitHead = NULL;
+	stack->waitTail = NULL;
+	stack->pool = NULL;
+	stack->ownsPool = false;
+
+	stack->inlineUsed = 0;
+	stack->inlineFree = &(stack->inlineFrames[0]);
+	for (size_t i = 0; i < DYNSTACK_INLINE_FRAMES; i++) {
+		stack->inlineFrames[i].data = NULL;
+		stack->inlineFrames[i].next = (i + 1 < DYNSTACK_INLINE_FRAMES) ? &(stack->inlineFrames[i + 1]) : NULL;
+	}
+
+	return true;
+}
+
+
+DynStack *dynstackNewRealtime(void (*deleteFunc)(void *), char *(*printFunc)(void *), unsigned int flags, size_t budget) {
+	DynFramePool *pool = dynstackPoolNewLocked(budget);
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	DynStack *toReturn = dynstackNewFlags(deleteFunc, printFunc, flags);
+	if (toReturn == NULL) {
+		dynstackPoolFree(pool);
+		return NULL;
+	}
 
+	toReturn->pool = pool;
+	toReturn->ownsPool = true;
+	toReturn->flags |= DYNSTACK_REALTIME;
 	return toReturn;
 }
 
@@ -42,11 +391,15 @@ void dynstackClear(DynStack *stack) {
 		return;
 	}
 
-	while (!dynstackIsEmpty(stack)) {
-		// stackPop already removes and frees the stack DynFrame struct,
-		// so we only have to delete the frame's stored data
-		stack->deleteData(dynstackPop(stack));
-	}
+	// Detach every frame at once, so the lock isn't held while the data is deleted
+	lockStack(stack);
+	DynFrame *cur = stack->top;
+	size_t count = stack->size;
+	stack->top = NULL;
+	stack->size = 0;
+	unlockStack(stack);
+
+	deleteChain(stack, cur, count);
 }
 
 
@@ -55,41 +408,179 @@ void dynstackFree(DynStack *stack) {
 		return;
 	}
 
-	dynstackClear(stack);
+	dynstackDestroy(stack);
 	free(stack);
 }
 
 
-bool dynstackPush(DynStack *stack, void *data) {
+void dynstackDestroy(DynStack *stack) {
 	if (stack == NULL) {
-		return false;
+		return;
+	}
+
+	dynstackClear(stack);
+	if (stack->ownsPool) {
+		dynstackPoolFree(stack->pool);
+		stack->pool = NULL;
+		stack->ownsPool = false;
 	}
+}
 
-	DynFrame *toPush = dynstackFrameNew(data);
 
-	// Can't assume malloc works every time, no matter how unlikely
+/*
+ * Pushes `data`, or hands it directly to a waiter. The frame comes from the stack's inline
+ * frames or pool within the same critical section as the push, and is only allocated (with
+ * the stack unlocked) if there is none and `allocate` is set.
+ * Returns false if no frame can be had, or if the stack is already as large as it can get.
+ */
+static bool pushFrame(DynStack *stack, void *data, bool allocate) {
+	lockStack(stack);
+	DynFrame *toPush = takeFrame(stack);
 	if (toPush == NULL) {
+		unlockStack(stack);
+
+		// A real-time stack never allocates, so it runs out of frames instead
+		if (!allocate || (stack->flags & DYNSTACK_REALTIME)) {
+			return false;
+		}
+
+		// Can't assume malloc works every time, no matter how unlikely
+		toPush = dynstackFrameNew(data);
+		if (toPush == NULL) {
+			return false;
+		}
+
+		lockStack(stack);
+		if (stack->pool != NULL) {
+			(stack->pool->allocations)++;
+		}
+	}
+	toPush->data = data;
+
+	if (stack->size == SIZE_MAX) {
+		// One more element would wrap the count around to 0
+		DynFrame *toFree = putFrame(stack, toPush);
+		unlockStack(stack);
+		free(toFree);
 		return false;
 	}
 
+	if (stack->waitHead != NULL) {
+		// Someone is waiting on an empty stack, so the element goes straight to them
+		DynWaiter *waiter = stack->waitHead;
+		stack->waitHead = waiter->next;
+		DynFrame *toFree = putFrame(stack, toPush);
+		unlockStack(stack);
+
+		free(toFree);
+		waiter->data = data;
+		waiter->callback(data, waiter->arg);
+		return true;
+	}
+
 	toPush->next = stack->top;
 	stack->top = toPush;
 	(stack->size)++;
+	unlockStack(stack);
+	return true;
+}
+
+
+bool dynstackPush(DynStack *stack, void *data) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	return pushFrame(stack, data, true);
+}
+
+
+bool dynstackPushNoAlloc(DynStack *stack, void *data) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	return pushFrame(stack, data, false);
+}
+
+
+bool dynstackPushChain(DynStack *stack, DynFrame *top, DynFrame *bottom, size_t count) {
+	if (stack == NULL || top == NULL || bottom == NULL) {
+		return false;
+	}
+
+	// Pair off waiters with the top of the chain, and call them (and free the frames that
+	// have nowhere to go) once the stack is unlocked
+	DynWaiter *served = NULL;
+	DynWaiter **servedLink = &served;
+	DynFrame *toFree = NULL;
+
+	lockStack(stack);
+	if (count > SIZE_MAX - stack->size) {
+		unlockStack(stack);
+		return false;
+	}
+
+	while (stack->waitHead != NULL && top != NULL) {
+		DynWaiter *waiter = stack->waitHead;
+		stack->waitHead = waiter->next;
+
+		DynFrame *handed = top;
+		top = (handed == bottom) ? NULL : handed->next;
+		count--;
+
+		waiter->data = handed->data;
+		if (putFrame(stack, handed) != NULL) {
+			handed->next = toFree;
+			toFree = handed;
+		}
+		*servedLink = waiter;
+		servedLink = &(waiter->next);
+	}
+	*servedLink = NULL;
+
+	if (top != NULL) {
+		bottom->next = stack->top;
+		stack->top = top;
+		stack->size += count;
+	}
+	unlockStack(stack);
+
+	while (toFree != NULL) {
+		DynFrame *next = toFree->next;
+		free(toFree);
+		toFree = next;
+	}
+
+	while (served != NULL) {
+		DynWaiter *next = served->next;
+		served->callback(served->data, served->arg);
+		served = next;
+	}
 	return true;
 }
 
 
 void *dynstackPeek(const DynStack *stack) {
-	if (stack == NULL || stack->top == NULL) {
+	if (stack == NULL) {
 		return NULL;
 	}
 
-	return stack->top->data;
+	lockStack(stack);
+	void *toReturn = (stack->top == NULL) ? NULL : stack->top->data;
+	unlockStack(stack);
+	return toReturn;
 }
 
 
 void *dynstackPop(DynStack *stack) {
-	if (stack == NULL || stack->top == NULL) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	lockStack(stack);
+	if (stack->top == NULL) {
+		unlockStack(stack);
 		return NULL;
 	}
 
@@ -97,21 +588,418 @@ void *dynstackPop(DynStack *stack) {
 	DynFrame *top = stack->top;
 	void *toReturn = top->data;
 
-	// Move the stack pointer
+	// Move the stack pointer, and recycle the removed frame while the stack is still locked
 	stack->top = stack->top->next;
 	(stack->size)--;
+	DynFrame *toFree = putFrame(stack, top);
+	unlockStack(stack);
+
+	// Free the removed frame if it can't be recycled, and return its data
+	free(toFree);
+	return toReturn;
+}
+
+
+DynAwait dynstackAwaitPop(DynStack *stack, void **data, DynWaiter *waiter) {
+	if (stack == NULL || data == NULL || waiter == NULL || waiter->callback == NULL) {
+		return DYNSTACK_AWAIT_ERROR;
+	}
+
+	lockStack(stack);
+	if (stack->top == NULL) {
+		// The waiter joins the end of the queue, so waiters are served oldest first
+		waiter->data = NULL;
+		waiter->next = NULL;
+		if (stack->waitHead == NULL) {
+			stack->waitHead = waiter;
+		} else {
+			stack->waitTail->next = waiter;
+		}
+		stack->waitTail = waiter;
+		unlockStack(stack);
+		return DYNSTACK_AWAIT_PENDING;
+	}
+
+	DynFrame *top = stack->top;
+	stack->top = top->next;
+	(stack->size)--;
+	*data = top->data;
+	DynFrame *toFree = putFrame(stack, top);
+	unlockStack(stack);
+
+	free(toFree);
+	return DYNSTACK_AWAIT_READY;
+}
+
+
+bool dynstackCancelAwait(DynStack *stack, DynWaiter *waiter) {
+	if (stack == NULL || waiter == NULL) {
+		return false;
+	}
+
+	lockStack(stack);
+	DynWaiter *prev = NULL;
+	DynWaiter *cur = stack->waitHead;
+	while (cur != NULL && cur != waiter) {
+		prev = cur;
+		cur = cur->next;
+	}
+
+	if (cur != NULL) {
+		if (prev == NULL) {
+			stack->waitHead = cur->next;
+		} else {
+			prev->next = cur->next;
+		}
+
+		if (stack->waitTail == cur) {
+			stack->waitTail = prev;
+		}
+	}
+	unlockStack(stack);
+
+	return cur != NULL;
+}
+
+
+void dynstackDeleteData(const DynStack *stack, void *data) {
+	if (stack != NULL && ownsData(stack)) {
+		stack->deleteData(data);
+	}
+}
+
+
+DynFrame *dynstackDetachAll(DynStack *stack) {
+	if (stack == NULL) {
+		return NULL;
+	}
+
+	lockStack(stack);
+	DynFrame *toReturn = stack->top;
+	stack->top = NULL;
+	stack->size = 0;
+	unlockStack(stack);
+
+	return toReturn;
+}
+
+
+void dynstackReleaseFrames(DynStack *stack, DynFrame *top) {
+	if (stack == NULL || top == NULL) {
+		return;
+	}
+
+	size_t count = 1;
+	DynFrame *bottom = top;
+	while (bottom->next != NULL) {
+		bottom = bottom->next;
+		count++;
+	}
+
+	releaseChain(stack, top, bottom, count);
+}
+
+
+DynMark dynstackMark(const DynStack *stack) {
+	return dynstackGetSize(stack);
+}
+
+
+bool dynstackRewind(DynStack *stack, DynMark mark) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	lockStack(stack);
+	if (mark > stack->size) {
+		unlockStack(stack);
+		return false;
+	}
+
+	// Cut the chain just above the marked frame, then delete everything above the cut
+	// once the stack is unlocked
+	size_t count = stack->size - mark;
+	if (count == 0) {
+		unlockStack(stack);
+		return true;
+	}
+
+	DynFrame *discarded = stack->top;
+	DynFrame *last = discarded;
+	for (size_t i = 1; i < count; i++) {
+		last = last->next;
+	}
+	stack->top = last->next;
+	last->next = NULL;
+	stack->size = mark;
+	unlockStack(stack);
+
+	deleteChain(stack, discarded, count);
+	return true;
+}
+
+
+bool dynstackTrim(DynStack *stack, size_t keep) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	lockStack(stack);
+	if (keep >= stack->size) {
+		unlockStack(stack);
+		return true;
+	}
+
+	// Cut the chain below the `keep`th frame, then delete everything below the cut
+	// once the stack is unlocked
+	size_t count = stack->size - keep;
+	DynFrame *discarded;
+	if (keep == 0) {
+		discarded = stack->top;
+		stack->top = NULL;
+	} else {
+		DynFrame *last = stack->top;
+		for (size_t i = 1; i < keep; i++) {
+			last = last->next;
+		}
+		discarded = last->next;
+		last->next = NULL;
+	}
+	stack->size = keep;
+	unlockStack(stack);
+
+	deleteChain(stack, discarded, count);
+	return true;
+}
+
+
+bool dynstackMoveTop(DynStack *from, DynStack *to) {
+	if (from == NULL || to == NULL) {
+		return false;
+	}
+
+	lockStack(from);
+	DynFrame *top = from->top;
+	if (top == NULL) {
+		unlockStack(from);
+		return false;
+	}
+	from->top = top->next;
+	(from->size)--;
+	unlockStack(from);
+
+	// The frame itself moves, so nothing is allocated or freed, unless it is built into `from`
+	DynFrame *moved = top;
+	if (isInline(from, top)) {
+		moved = acquireFrame(to, top->data, true);
+	}
+
+	// Put the element back if `to` can't take it
+	if (moved == NULL || !dynstackPushChain(to, moved, moved, 1)) {
+		if (moved != NULL && moved != top) {
+			releaseFrame(to, moved);
+		}
+
+		lockStack(from);
+		top->next = from->top;
+		from->top = top;
+		(from->size)++;
+		unlockStack(from);
+		return false;
+	}
+
+	if (moved != top) {
+		releaseFrame(from, top);
+	}
+	return true;
+}
+
+
+DynFramePool *dynstackPoolNew(void) {
+	DynFramePool *toReturn = malloc(sizeof(DynFramePool));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	toReturn->frames = NULL;
+	toReturn->count = 0;
+	toReturn->allocations = 0;
+	toReturn->blockSize = 0;
+
+	return toReturn;
+}
+
+
+DynFramePool *dynstackPoolNewLocked(size_t count) {
+	// The pool goes first, then the frames, which fill up whatever the last page has left
+	size_t frameOffset = (sizeof(DynFramePool) + sizeof(DynFrame) - 1) / sizeof(DynFrame) * sizeof(DynFrame);
+	if (count > (SIZE_MAX - frameOffset - dynstackPageSize()) / sizeof(DynFrame)) {
+		return NULL;
+	}
+	size_t blockSize = dynstackPageRound(frameOffset + count * sizeof(DynFrame));
+
+	void *block = dynstackVMemReserve(blockSize);
+	if (block == NULL) {
+		return NULL;
+	}
+	if (!dynstackVMemCommit(block, blockSize) || !dynstackVMemLock(block, blockSize)) {
+		dynstackVMemRelease(block, blockSize);
+		return NULL;
+	}
+
+	DynFramePool *toReturn = block;
+	toReturn->frames = NULL;
+	toReturn->count = (blockSize - frameOffset) / sizeof(DynFrame);
+	toReturn->allocations = 0;
+	toReturn->blockSize = blockSize;
+
+	// Link the frames so that they are handed out in address order
+	DynFrame *frames = (DynFrame *)((char *)block + frameOffset);
+	for (size_t i = toReturn->count; i > 0; i--) {
+		frames[i - 1].data = NULL;
+		frames[i - 1].next = toReturn->frames;
+		toReturn->frames = &frames[i - 1];
+	}
 
-	// Free the removed frame and return its data
-	free(top);
 	return toReturn;
 }
 
 
-unsigned int dynstackGetSize(const DynStack *stack) {
+void dynstackPoolFree(DynFramePool *pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	// Frames carved out of a locked pool's block go away with the block
+	char *blockStart = (char *)pool;
+	char *blockEnd = blockStart + pool->blockSize;
+
+	DynFrame *cur = pool->frames;
+	while (cur != NULL) {
+		DynFrame *next = cur->next;
+		if ((char *)cur < blockStart || (char *)cur >= blockEnd) {
+			free(cur);
+		}
+		cur = next;
+	}
+
+	if (pool->blockSize > 0) {
+		dynstackVMemRelease(pool, pool->blockSize);
+	} else {
+		free(pool);
+	}
+}
+
+
+bool dynstackSetPool(DynStack *stack, DynFramePool *pool) {
+	if (stack == NULL) {
+		return false;
+	}
+
+	// A real-time stack's frames live inside its locked pool, so the pool can't go away
+	lockStack(stack);
+	if (stack->flags & DYNSTACK_REALTIME) {
+		unlockStack(stack);
+		return false;
+	}
+
+	DynFramePool *owned = stack->ownsPool ? stack->pool : NULL;
+	stack->ownsPool = false;
+	stack->pool = pool;
+	unlockStack(stack);
+
+	// Nothing else can be using a pool the stack made for itself
+	if (owned != pool) {
+		dynstackPoolFree(owned);
+	}
+	return true;
+}
+
+
+bool dynstackReserve(DynStack *stack, size_t count) {
+	// A real-time stack's pool only holds frames that are already paged in and locked
+	if (stack == NULL || (stack->flags & DYNSTACK_REALTIME)) {
+		return false;
+	}
+
+	// Nothing is allocated while the stack is locked: the pool and the frames it lacks are
+	// made first, then installed and spliced in
+	lockStack(stack);
+	bool hasPool = stack->pool != NULL;
+	unlockStack(stack);
+
+	if (!hasPool) {
+		DynFramePool *pool = dynstackPoolNew();
+		if (pool == NULL) {
+			return false;
+		}
+
+		lockStack(stack);
+		if (stack->pool == NULL) {
+			stack->pool = pool;
+			stack->ownsPool = true;
+			pool = NULL;
+		}
+		unlockStack(stack);
+
+		// Someone else gave the stack a pool in the meantime
+		dynstackPoolFree(pool);
+	}
+
+	lockStack(stack);
+	DynFramePool *pool = stack->pool;
+	size_t missing = (pool != NULL && pool->count < count) ? count - pool->count : 0;
+	unlockStack(stack);
+
+	DynFrame *top = NULL;
+	DynFrame *bottom = NULL;
+	size_t made = 0;
+	while (made < missing) {
+		DynFrame *frame = dynstackFrameNew(NULL);
+		if (frame == NULL) {
+			break;
+		}
+
+		frame->next = top;
+		top = frame;
+		if (bottom == NULL) {
+			bottom = frame;
+		}
+		made++;
+	}
+
+	if (top != NULL) {
+		lockStack(stack);
+		pool = stack->pool;
+		if (pool == NULL) {
+			// The pool was taken away in the meantime, so the frames have nowhere to go
+			unlockStack(stack);
+			dynstackReleaseFrames(stack, top);
+			return false;
+		}
+
+		bottom->next = pool->frames;
+		pool->frames = top;
+		pool->count += made;
+		pool->allocations += made;
+		unlockStack(stack);
+	}
+
+	return made == missing;
+}
+
+
+size_t dynstackGetSize(const DynStack *stack) {
 	if (stack == NULL) {
 		return 0;
 	}
-	return stack->size;
+
+	lockStack(stack);
+	size_t toReturn = stack->size;
+	unlockStack(stack);
+	return toReturn;
 }
 
 
@@ -126,12 +1014,16 @@ char *dynstackTopToString(const DynStack *stack) {
 	}
 
 	char *toReturn;
-	if (dynstackIsEmpty(stack)) {
+	lockStack(stack);
+	if (stack->top == NULL) {
 		toReturn = malloc(sizeof(char));
 		toReturn[0] = '\0';
+	} else if (stack->printData == NULL) {
+		toReturn = countToString(1);
 	} else {
 		toReturn = stack->printData(stack->top->data);
 	}
+	unlockStack(stack);
 
 	return toReturn;
 }
@@ -149,60 +1041,520 @@ void dynstackPrintTop(const DynStack *stack) {
 
 
 char *dynstackToString(const DynStack *stack) {
+	return dynstackToStringRange(stack, 0, SIZE_MAX);
+}
+
+
+void dynstackPrint(const DynStack *stack) {
+	if (stack == NULL) {
+		return;
+	}
+
+	char *toPrint = dynstackToString(stack);
+	printf("%s\n", toPrint);
+	free(toPrint);
+}
+
+
+char *dynstackToStringRange(const DynStack *stack, size_t from, size_t to) {
 	if (stack == NULL) {
 		return NULL;
 	}
 
-	// Start with the top of the stack
-	char *toReturn = dynstackTopToString(stack);
-	size_t length = strlen(toReturn);
+	if (stack->printData == NULL) {
+		// Only the number of elements in the range can be shown
+		lockStack(stack);
+		size_t count = 0;
+		size_t position = 0;
+		for (DynFrame *cur = stack->top; cur != NULL && position < to; cur = cur->next, position++) {
+			if (position >= from) {
+				count++;
+			}
+		}
+		unlockStack(stack);
+		return countToString(count);
+	}
 
-	// Prepare to iterate over the rest of the stack beyond the top
-	DynFrame *cur;
-	if (dynstackIsEmpty(stack)) {
-		// If the stack is empty then `cur = stack->top->next`
-		// will error out or segfault since `stack->top` is NULL,
-		// so this guard is necessary
-		cur = NULL;
-	} else {
-		cur = stack->top->next;
+	size_t length = 0;
+	size_t capacity = 64;
+	char *toReturn = malloc(capacity);
+	if (toReturn == NULL) {
+		return NULL;
 	}
+	toReturn[0] = '\0';
 
-	while (cur != NULL) {
+	// Skip to the start of the range, then stop as soon as the end of the range is reached
+	lockStack(stack);
+	DynFrame *cur = stack->top;
+	size_t position = 0;
+	for (; cur != NULL && position < from; position++) {
+		cur = cur->next;
+	}
+
+	for (; cur != NULL && position < to; position++) {
 		char *frameStr = stack->printData(cur->data);
-		length += strlen(frameStr) + 1;	// +1 for newline
-		toReturn = realloc(toReturn, length + 1);	// +1 for null terminator
-		strcat(toReturn, "\n");
-		strcat(toReturn, frameStr);
+		size_t frameLength = strlen(frameStr);
+
+		// The buffer grows geometrically, so building the string stays linear
+		size_t needed = length + frameLength + 2;	// +1 for newline, +1 for null terminator
+		if (needed > capacity) {
+			while (needed > capacity) {
+				capacity *= 2;
+			}
+			char *grown = realloc(toReturn, capacity);
+			if (grown == NULL) {
+				unlockStack(stack);
+				free(frameStr);
+				free(toReturn);
+				return NULL;
+			}
+			toReturn = grown;
+		}
+
+		if (position != from) {
+			toReturn[length++] = '\n';
+		}
+		memcpy(toReturn + length, frameStr, frameLength + 1);
+		length += frameLength;
 		free(frameStr);
 
 		cur = cur->next;
 	}
+	unlockStack(stack);
 
 	return toReturn;
 }
 
 
-void dynstackPrint(const DynStack *stack) {
+char *dynstackToStringN(const DynStack *stack, size_t n) {
+	return dynstackToStringRange(stack, 0, n);
+}
+
+
+void dynstackPrintRange(const DynStack *stack, size_t from, size_t to) {
 	if (stack == NULL) {
 		return;
 	}
 
-	char *toPrint = dynstackToString(stack);
+	char *toPrint = dynstackToStringRange(stack, from, to);
 	printf("%s\n", toPrint);
 	free(toPrint);
 }
 
 
+/*
+ * Reads the elements of a stack as records (serialized elements, or strings from the stack's
+ * `printData`) from the top down, for the output functions.
+ *
+ * The lock of a DYNSTACK_THREADSAFE stack mustn't be held while writing to a file, since every
+ * push and pop would spin on it for as long as the I/O takes. Those stacks are copied into
+ * `records` within one critical section, and written out afterwards. Other stacks are read
+ * one frame at a time as they are written, so that no copy of the stack is ever made.
+ */
+typedef struct recordCursor {
+	DynFrame *frame;			// Next frame to read, if the stack is read directly
+	void **records;				// Copied records, if the stack is DYNSTACK_THREADSAFE
+	size_t *lengths;			// Length of every copied record
+	size_t index;				// Number of records read so far
+	size_t count;				// Number of records in total
+	void *(*serializeFunc)(void *, size_t *);	// Makes the records, or NULL to use `printData`
+	char *(*printData)(void *);
+} RecordCursor;
+
+
+/*
+ * Turns `data` into a malloc'd record and stores its length, or returns NULL.
+ */
+static void *makeRecord(const RecordCursor *cursor, void *data, size_t *length) {
+	if (cursor->serializeFunc != NULL) {
+		*length = 0;
+		return cursor->serializeFunc(data, length);
+	}
+
+	char *toReturn = cursor->printData(data);
+	*length = (toReturn == NULL) ? 0 : strlen(toReturn);
+	return toReturn;
+}
+
+
+/*
+ * Starts reading the records of `stack`. Returns false if a copy of the stack can't be made.
+ */
+static bool openCursor(RecordCursor *cursor, const DynStack *stack, void *(*serializeFunc)(void *, size_t *)) {
+	cursor->frame = NULL;
+	cursor->records = NULL;
+	cursor->lengths = NULL;
+	cursor->index = 0;
+	cursor->serializeFunc = serializeFunc;
+	cursor->printData = stack->printData;
+
+	if (!(stack->flags & DYNSTACK_THREADSAFE)) {
+		cursor->frame = stack->top;
+		cursor->count = stack->size;
+		return true;
+	}
+
+	lockStack(stack);
+	cursor->count = stack->size;
+	size_t slots = (cursor->count > 0) ? cursor->count : 1;
+	if (slots > SIZE_MAX / sizeof(void *)
+			|| (cursor->records = malloc(slots * sizeof(void *))) == NULL
+			|| (cursor->lengths = malloc(slots * sizeof(size_t))) == NULL) {
+		unlockStack(stack);
+		free(cursor->records);
+		return false;
+	}
+
+	size_t made = 0;
+	for (DynFrame *cur = stack->top; cur != NULL; cur = cur->next) {
+		cursor->records[made] = makeRecord(cursor, cur->data, &(cursor->lengths[made]));
+		if (cursor->records[made] == NULL) {
+			break;
+		}
+		made++;
+	}
+	unlockStack(stack);
+
+	if (made < cursor->count) {
+		while (made > 0) {
+			free(cursor->records[--made]);
+		}
+		free(cursor->records);
+		free(cursor->lengths);
+		return false;
+	}
+	return true;
+}
+
+
+/*
+ * Returns the next record, which the caller must free, and stores its length. Returns NULL
+ * once every record has been read, or if a record can't be made (so `index < count`).
+ */
+static void *nextRecord(RecordCursor *cursor, size_t *length) {
+	if (cursor->index == cursor->count) {
+		return NULL;
+	}
+
+	void *toReturn;
+	if (cursor->records != NULL) {
+		toReturn = cursor->records[cursor->index];
+		*length = cursor->lengths[cursor->index];
+	} else {
+		toReturn = makeRecord(cursor, cursor->frame->data, length);
+		if (toReturn == NULL) {
+			return NULL;
+		}
+		cursor->frame = cursor->frame->next;
+	}
+
+	(cursor->index)++;
+	return toReturn;
+}
+
+
+/*
+ * Frees every record that wasn't read, and the copy of the stack.
+ */
+static void closeCursor(RecordCursor *cursor) {
+	if (cursor->records != NULL) {
+		for (size_t i = cursor->index; i < cursor->count; i++) {
+			free(cursor->records[i]);
+		}
+	}
+	free(cursor->records);
+	free(cursor->lengths);
+}
+
+
+/*
+ * Writes `str` to `fp` as the contents of a JSON string.
+ *
+ * strcspn skips over runs of characters that don't need escaping (it compares a whole
+ * block of bytes at a time on most C libraries), so each run is written with one fwrite
+ * and only the rare special characters are handled one by one.
+ */
+static bool writeJSONString(FILE *fp, const char *str) {
+	static const char special[] = "\"\\"
+		"\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+		"\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f";
+
+	while (*str != '\0') {
+		size_t run = strcspn(str, special);
+		if (fwrite(str, 1, run, fp) != run) {
+			return false;
+		}
+		str += run;
+
+		if (*str == '\0') {
+			break;
+		}
+
+		int written;
+		switch (*str) {
+			case '"':	written = fputs("\\\"", fp); break;
+			case '\\':	written = fputs("\\\\", fp); break;
+			case '\n':	written = fputs("\\n", fp); break;
+			case '\r':	written = fputs("\\r", fp); break;
+			case '\t':	written = fputs("\\t", fp); break;
+			default:	written = fprintf(fp, "\\u%04x", (unsigned char)*str); break;
+		}
+		if (written < 0) {
+			return false;
+		}
+		str++;
+	}
+
+	return true;
+}
+
+
+bool dynstackWriteJSON(const DynStack *stack, FILE *fp) {
+	if (stack == NULL || fp == NULL || stack->printData == NULL) {
+		return false;
+	}
+
+	RecordCursor cursor;
+	if (!openCursor(&cursor, stack, NULL)) {
+		return false;
+	}
+
+	bool ok = (fputc('[', fp) != EOF);
+	while (ok && cursor.index < cursor.count) {
+		size_t length;
+		bool first = (cursor.index == 0);
+		char *frameStr = nextRecord(&cursor, &length);
+		ok = frameStr != NULL
+			&& (first || fputc(',', fp) != EOF)
+			&& fputc('"', fp) != EOF
+			&& writeJSONString(fp, frameStr)
+			&& fputc('"', fp) != EOF;
+		free(frameStr);
+	}
+	closeCursor(&cursor);
+
+	return ok && fputs("]\n", fp) != EOF;
+}
+
+
+bool dynstackWriteDelimited(const DynStack *stack, FILE *fp) {
+	if (stack == NULL || fp == NULL || stack->printData == NULL) {
+		return false;
+	}
+
+	RecordCursor cursor;
+	if (!openCursor(&cursor, stack, NULL)) {
+		return false;
+	}
+
+	bool ok = true;
+	while (ok && cursor.index < cursor.count) {
+		size_t length;
+		char *frameStr = nextRecord(&cursor, &length);
+		ok = frameStr != NULL
+			&& fprintf(fp, "%zu:", length) > 0
+			&& fwrite(frameStr, 1, length, fp) == length
+			&& fputc(',', fp) != EOF;
+		free(frameStr);
+	}
+	closeCursor(&cursor);
+
+	return ok;
+}
+
+
 void dynstackMap(DynStack *stack, void (*func)(void *)) {
-	if (stack == NULL || dynstackIsEmpty(stack)) {
+	if (stack == NULL) {
 		return;
 	}
 
+	lockStack(stack);
 	DynFrame *cur = stack->top;
 	while (cur != NULL) {
 		func(cur->data);
 		cur = cur->next;
 	}
+	unlockStack(stack);
+}
+
+
+
+/*
+ * Appends `length` bytes to the save buffer, flushing it to `fp` first if they don't fit.
+ * Data too large for the buffer is written directly. Returns false if a write fails.
+ */
+static bool bufferedWrite(FILE *fp, char *buffer, size_t *used, const void *data, size_t length) {
+	if (*used + length > DYNSTACK_IO_BUFFER_SIZE) {
+		if (fwrite(buffer, 1, *used, fp) != *used) {
+			return false;
+		}
+		*used = 0;
+	}
+
+	if (length > DYNSTACK_IO_BUFFER_SIZE) {
+		return fwrite(data, 1, length, fp) == length;
+	}
+
+	memcpy(buffer + *used, data, length);
+	*used += length;
+	return true;
+}
+
+
+bool dynstackSave(const DynStack *stack, const char *filename, void *(*serializeFunc)(void *, size_t *)) {
+	if (stack == NULL || filename == NULL || serializeFunc == NULL) {
+		return false;
+	}
+
+	// The stack is written next to `filename` and only renamed over it once it is complete,
+	// so the previous file survives a crash or a failure partway through
+	size_t nameLength = strlen(filename);
+	char *tempName = malloc(nameLength + sizeof(".tmp"));
+	if (tempName == NULL) {
+		return false;
+	}
+	memcpy(tempName, filename, nameLength);
+	memcpy(tempName + nameLength, ".tmp", sizeof(".tmp"));
+
+	FILE *fp = fopen(tempName, "wb");
+	if (fp == NULL) {
+		free(tempName);
+		return false;
+	}
+
+	RecordCursor cursor;
+	char *buffer = malloc(DYNSTACK_IO_BUFFER_SIZE);
+	if (buffer == NULL || !openCursor(&cursor, stack, serializeFunc)) {
+		free(buffer);
+		fclose(fp);
+		unlink(tempName);
+		free(tempName);
+		return false;
+	}
+
+	// The payload size isn't known until every element has been serialized,
+	// so the header is written once now and then rewritten at the end
+	DynFileHeader header;
+	memcpy(header.magic, DYNSTACK_FILE_MAGIC, sizeof(header.magic));
+	header.version = DYNSTACK_FILE_VERSION;
+	header.count = cursor.count;
+	header.payloadBytes = 0;
+
+	size_t used = 0;
+	bool ok = bufferedWrite(fp, buffer, &used, &header, sizeof(header));
+
+	while (ok && cursor.index < cursor.count) {
+		size_t length;
+		void *record = nextRecord(&cursor, &length);
+		if (record == NULL) {
+			ok = false;
+			break;
+		}
+
+		uint64_t prefix = length;
+		ok = bufferedWrite(fp, buffer, &used, &prefix, sizeof(prefix))
+			&& bufferedWrite(fp, buffer, &used, record, length);
+		header.payloadBytes += length;
+		free(record);
+	}
+	closeCursor(&cursor);
+
+	if (ok) {
+		ok = fwrite(buffer, 1, used, fp) == used
+			&& fseek(fp, 0, SEEK_SET) == 0
+			&& fwrite(&header, sizeof(header), 1, fp) == 1
+			&& fflush(fp) == 0
+			&& fsync(fileno(fp)) == 0;
+	}
+
+	free(buffer);
+	if (fclose(fp) != 0) {
+		ok = false;
+	}
+
+	if (!ok || rename(tempName, filename) != 0) {
+		unlink(tempName);
+		ok = false;
+	}
+	free(tempName);
+	return ok;
 }
 
+
+DynStack *dynstackLoad(const char *filename, void (*deleteFunc)(void *), char *(*printFunc)(void *),
+		void *(*deserializeFunc)(const void *, size_t)) {
+	if (filename == NULL || deserializeFunc == NULL) {
+		return NULL;
+	}
+
+	FILE *fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		return NULL;
+	}
+
+	DynFileHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1
+			|| memcmp(header.magic, DYNSTACK_FILE_MAGIC, sizeof(header.magic)) != 0
+			|| header.version != DYNSTACK_FILE_VERSION
+			|| header.count > (SIZE_MAX - header.payloadBytes) / sizeof(uint64_t)) {
+		fclose(fp);
+		return NULL;
+	}
+
+	// Every record (lengths included) is read into one buffer with a single read
+	size_t total = header.count * sizeof(uint64_t) + header.payloadBytes;
+	char *records = malloc(total > 0 ? total : 1);
+	if (records == NULL || fread(records, 1, total, fp) != total) {
+		free(records);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+
+	DynStack *stack = dynstackNew(deleteFunc, printFunc);
+	if (stack == NULL) {
+		free(records);
+		return NULL;
+	}
+
+	// Records are stored top to bottom, so each new frame is linked
+	// below the previous one instead of being pushed on top of it
+	DynFrame **link = &(stack->top);
+	size_t offset = 0;
+	for (uint64_t i = 0; i < header.count; i++) {
+		if (total - offset < sizeof(uint64_t)) {
+			// An earlier length prefix was too long, and left no room for this one
+			break;
+		}
+
+		uint64_t length;
+		memcpy(&length, records + offset, sizeof(length));
+		offset += sizeof(length);
+
+		if (length > total - offset) {
+			// Corrupt length prefix; it points past the end of the file
+			break;
+		}
+
+		void *data = deserializeFunc(records + offset, length);
+		DynFrame *frame = dynstackFrameNew(data);
+		if (frame == NULL) {
+			dynstackDeleteData(stack, data);
+			break;
+		}
+		offset += length;
+
+		*link = frame;
+		link = &(frame->next);
+		(stack->size)++;
+	}
+
+	free(records);
+
+	// The records must account for exactly the bytes that the header announced
+	if (stack->size != header.count || offset != total) {
+		dynstackFree(stack);
+		return NULL;
+	}
+	return stack;
+}
@@ -0,0 +1,162 @@
+#include "DynUndo.h"
+
+
+// Bookkeeping charged to every recorded operation on top of its own cost
+#define ENTRY_OVERHEAD (sizeof(DynUndoEntry) + sizeof(DynFrame))
+
+
+static void deleteEntry(void *data) {
+	DynUndoEntry *entry = data;
+	entry->deleteOp(entry->op);
+	free(entry);
+}
+
+
+static char *printEntry(void *data) {
+	char *toReturn = malloc(32);
+	if (toReturn != NULL) {
+		snprintf(toReturn, 32, "<%zu bytes>", ((DynUndoEntry *)data)->cost);
+	}
+	return toReturn;
+}
+
+
+/*
+ * Returns the number of bytes charged for the entries held by `stack`.
+ */
+static size_t stackCost(const DynStack *stack) {
+	size_t toReturn = 0;
+	for (DynFrame *cur = stack->top; cur != NULL; cur = cur->next) {
+		toReturn += ((DynUndoEntry *)cur->data)->cost + ENTRY_OVERHEAD;
+	}
+	return toReturn;
+}
+
+
+/*
+ * Evicts the oldest operations until the history is down to three quarters of its budget,
+ * always keeping the most recent one.
+ */
+static void evictOldest(DynUndo *history) {
+	size_t target = history->budget / 4 * 3;
+	size_t kept = stackCost(history->redo);
+	size_t keep = 0;
+
+	for (DynFrame *cur = history->undo->top; cur != NULL; cur = cur->next) {
+		size_t cost = ((DynUndoEntry *)cur->data)->cost + ENTRY_OVERHEAD;
+		if (keep > 0 && kept + cost > target) {
+			break;
+		}
+		kept += cost;
+		keep++;
+	}
+
+	dynstackTrim(history->undo, keep);
+	history->used = kept;
+}
+
+
+DynUndo *dynstackUndoNew(size_t budget, void (*deleteFunc)(void *), bool (*coalesceFunc)(void *, void *)) {
+	if (deleteFunc == NULL) {
+		return NULL;
+	}
+
+	DynUndo *toReturn = malloc(sizeof(DynUndo));
+
+	// Can't assume malloc works every time, no matter how unlikely
+	if (toReturn == NULL) {
+		return NULL;
+	}
+
+	toReturn->undo = dynstackNew(deleteEntry, printEntry);
+	toReturn->redo = dynstackNew(deleteEntry, printEntry);
+	toReturn->budget = budget;
+	toReturn->used = 0;
+	toReturn->deleteOp = deleteFunc;
+	toReturn->coalesceOp = coalesceFunc;
+
+	if (toReturn->undo == NULL || toReturn->redo == NULL) {
+		dynstackUndoFree(toReturn);
+		return NULL;
+	}
+
+	return toReturn;
+}
+
+
+void dynstackUndoFree(DynUndo *history) {
+	if (history == NULL) {
+		return;
+	}
+
+	dynstackFree(history->undo);
+	dynstackFree(history->redo);
+	free(history);
+}
+
+
+bool dynstackUndoRecord(DynUndo *history, void *op, size_t cost) {
+	if (history == NULL || op == NULL) {
+		return false;
+	}
+
+	// Recording a new operation branches off the undone ones, so they can't be redone
+	history->used -= stackCost(history->redo);
+	dynstackClear(history->redo);
+
+	DynUndoEntry *previous = dynstackPeek(history->undo);
+	if (previous != NULL && history->coalesceOp != NULL && history->coalesceOp(previous->op, op)) {
+		history->deleteOp(op);
+		previous->cost += cost;
+		history->used += cost;
+	} else {
+		DynUndoEntry *entry = malloc(sizeof(DynUndoEntry));
+		if (entry == NULL) {
+			history->deleteOp(op);
+			return false;
+		}
+
+		entry->op = op;
+		entry->cost = cost;
+		entry->deleteOp = history->deleteOp;
+
+		if (!dynstackPush(history->undo, entry)) {
+			deleteEntry(entry);
+			return false;
+		}
+		history->used += cost + ENTRY_OVERHEAD;
+	}
+
+	if (history->used > history->budget) {
+		evictOldest(history);
+	}
+	return true;
+}
+
+
+void *dynstackUndo(DynUndo *history) {
+	if (history == NULL || !dynstackMoveTop(history->undo, history->redo)) {
+		return NULL;
+	}
+
+	return ((DynUndoEntry *)dynstackPeek(history->redo))->op;
+}
+
+
+void *dynstackRedo(DynUndo *history) {
+	if (history == NULL || !dynstackMoveTop(history->redo, history->undo)) {
+		return NULL;
+	}
+
+	return ((DynUndoEntry *)dynstackPeek(history->undo))->op;
+}
+
+
+bool dynstackCanUndo(const DynUndo *history) {
+	return history != NULL && !dynstackIsEmpty(history->undo);
+}
+
+
+bool dynstackCanRedo(const DynUndo *history) {
+	return history != NULL && !dynstackIsEmpty(history->redo);
+}
@@ -0,0 +1,54 @@
+#define _DEFAULT_SOURCE
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "DynVMem.h"
+
+
+size_t dynstackPageSize(void) {
+	static size_t pageSize = 0;
+	if (pageSize == 0) {
+		pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	}
+	return pageSize;
+}
+
+
+size_t dynstackPageRound(size_t size) {
+	size_t pageSize = dynstackPageSize();
+	return (size + pageSize - 1) / pageSize * pageSize;
+}
+
+
+void *dynstackVMemReserve(size_t size) {
+	// MAP_NORESERVE keeps huge reservations from counting against the commit limit
+	void *toReturn = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (toReturn == MAP_FAILED) {
+		return NULL;
+	}
+	return toReturn;
+}
+
+
+bool dynstackVMemCommit(void *addr, size_t size) {
+	return mprotect(addr, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+
+bool dynstackVMemLock(void *addr, size_t size) {
+	// Writing makes the kernel back each page with its own memory, not the shared zero page
+	size_t pageSize = dynstackPageSize();
+	for (size_t offset = 0; offset < size; offset += pageSize) {
+		((volatile char *)addr)[offset] = 0;
+	}
+
+	return mlock(addr, size) == 0;
+}
+
+
+void dynstackVMemRelease(void *addr, size_t size) {
+	if (addr != NULL) {
+		munmap(addr, size);
+	}
+}
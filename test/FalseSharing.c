@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "DynStack.h"
+
+/*
+ * Times workers that each push and pop on a DYNSTACK_THREADSAFE stack of their own, with
+ * the stacks laid out three ways:
+ *
+ *  unaligned : a plain `DynStack[]` set up with `dynstackInit`, starting half a cache line
+ *              past a boundary (as it may inside a larger struct), so the end of every stack
+ *              shares a line with the start of the next one
+ *  array     : the same array, starting on a cache line boundary
+ *  aligned   : stacks allocated separately with DYNSTACK_ALIGNED
+ *
+ * Every worker fills all of its stack's inline frames before popping them, so the whole
+ * struct is written to. Nothing is shared between the workers but the cache lines, so any
+ * difference between the runs is false sharing. It only shows up on a multi-core host.
+ */
+
+// Most workers run at once, whatever the number of cores
+#define MAX_WORKERS 8
+
+// Number of times every worker fills and empties its stack
+#define ROUNDS 2000000
+
+typedef enum layout {
+	LAYOUT_UNALIGNED,
+	LAYOUT_ARRAY,
+	LAYOUT_ALIGNED
+} Layout;
+
+
+static void *work(void *arg) {
+	DynStack *stack = arg;
+	for (long i = 0; i < ROUNDS; i++) {
+		for (long j = 0; j < DYNSTACK_INLINE_FRAMES; j++) {
+			dynstackPush(stack, (void *)j);
+		}
+		for (long j = 0; j < DYNSTACK_INLINE_FRAMES; j++) {
+			dynstackPop(stack);
+		}
+	}
+	return NULL;
+}
+
+
+static double nowSeconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+
+/*
+ * Runs `workers` threads on stacks laid out as `layout`, and prints the time per push+pop.
+ * Returns false if the stacks or threads can't be created.
+ */
+static bool measure(int workers, Layout layout, const char *name) {
+	DynStack *stacks[MAX_WORKERS];
+	pthread_t threads[MAX_WORKERS];
+
+	// Room for the array plus the half line it may be shifted by
+	void *block = NULL;
+	size_t blockSize = (size_t)workers * sizeof(DynStack) + DYNSTACK_CACHE_LINE;
+	if (layout != LAYOUT_ALIGNED && posix_memalign(&block, DYNSTACK_CACHE_LINE, blockSize) != 0) {
+		return false;
+	}
+
+	DynStack *array = NULL;
+	if (block != NULL) {
+		size_t shift = (layout == LAYOUT_UNALIGNED) ? DYNSTACK_CACHE_LINE / 2 : 0;
+		array = (DynStack *)((char *)block + shift);
+	}
+
+	for (int i = 0; i < workers; i++) {
+		if (array != NULL) {
+			stacks[i] = &(array[i]);
+			dynstackInit(stacks[i], NULL, NULL, DYNSTACK_THREADSAFE);
+		} else if ((stacks[i] = dynstackNewFlags(NULL, NULL, DYNSTACK_THREADSAFE | DYNSTACK_ALIGNED)) == NULL) {
+			while (i > 0) {
+				dynstackFree(stacks[--i]);
+			}
+			return false;
+		}
+	}
+
+	bool ok = true;
+	int started = 0;
+	double start = nowSeconds();
+	for (; started < workers; started++) {
+		if (pthread_create(&threads[started], NULL, work, stacks[started]) != 0) {
+			ok = false;
+			break;
+		}
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double elapsed = nowSeconds() - start;
+
+	for (int i = 0; i < workers; i++) {
+		if (array != NULL) {
+			dynstackDestroy(stacks[i]);
+		} else {
+			dynstackFree(stacks[i]);
+		}
+	}
+	free(block);
+
+	if (ok) {
+		double pairs = (double)ROUNDS * DYNSTACK_INLINE_FRAMES;
+		printf("%-9s: %d workers, %.1f ns per push+pop per worker\n", name, workers, elapsed * 1e9 / pairs);
+	}
+	return ok;
+}
+
+
+int main(void) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int workers = (cores < 2) ? 2 : (cores > MAX_WORKERS) ? MAX_WORKERS : (int)cores;
+	if (cores < 2) {
+		printf("Only one core is online, so false sharing can't be observed\n");
+	}
+
+	bool ok = measure(workers, LAYOUT_UNALIGNED, "unaligned")
+		&& measure(workers, LAYOUT_ARRAY, "array")
+		&& measure(workers, LAYOUT_ALIGNED, "aligned");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "DynStack.h"
+
+/*
+ * Measures the worst-case latency of pushes and pops on a real-time stack, next to a plain
+ * stack doing the same work. The stack is filled and drained in bursts, so that every frame
+ * of the budget is used. Fails if the real-time stack allocates or runs out of frames.
+ */
+
+// Number of elements the real-time stack has room for, and the height of every burst
+#define BUDGET 100000
+#define BURST 50000
+
+// Number of pushes and pops timed on each stack
+#define OPERATIONS 10000000
+
+// Latency above which an operation is counted as slow, in nanoseconds
+#define SLOW_NS 2000
+
+
+static long long nowNs(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+/*
+ * Times every operation of the bursts on `stack`, and prints the results.
+ * Returns false if a push fails.
+ */
+static bool measure(DynStack *stack, const char *name) {
+	long long worst = 0;
+	long long slow = 0;
+	long long start = nowNs();
+
+	for (long i = 0; i < OPERATIONS; i++) {
+		bool pushing = (i / BURST) % 2 == 0;
+
+		long long before = nowNs();
+		if (pushing) {
+			if (!dynstackPush(stack, (void *)i)) {
+				printf("%s: push %ld failed\n", name, i);
+				return false;
+			}
+		} else {
+			dynstackPop(stack);
+		}
+		long long elapsed = nowNs() - before;
+
+		if (elapsed > worst) {
+			worst = elapsed;
+		}
+		if (elapsed > SLOW_NS) {
+			slow++;
+		}
+	}
+
+	printf("%-9s: %.1f ns/op average, %lld ns worst, %lld of %d ops over %d ns\n", name,
+			(double)(nowNs() - start) / OPERATIONS, worst, slow, OPERATIONS, SLOW_NS);
+	return true;
+}
+
+
+int main(void) {
+	DynStack *realtime = dynstackNewRealtime(NULL, NULL, 0, BUDGET);
+	if (realtime == NULL) {
+		printf("Can't lock %d frames (check RLIMIT_MEMLOCK)\n", BUDGET);
+		return 1;
+	}
+
+	bool ok = measure(realtime, "realtime");
+	if (realtime->pool->allocations != 0) {
+		printf("realtime: %zu frames were allocated\n", realtime->pool->allocations);
+		ok = false;
+	}
+	dynstackFree(realtime);
+
+	DynStack *plain = dynstackNew(NULL, NULL);
+	if (plain == NULL) {
+		return 1;
+	}
+	ok = measure(plain, "plain") && ok;
+	dynstackFree(plain);
+
+	return ok ? 0 : 1;
+}